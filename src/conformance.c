@@ -0,0 +1,443 @@
+#include "conformance.h"
+#include "cpu.h"
+#include "instructions.h"
+#include "predecode.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+// Every store lands here: plain addressing is 0xFxxxx and ES is limited
+// to 0x0 (code flash, which ignores writes) and 0xF
+#define WINDOW_BASE 0xF0000
+#define WINDOW_SIZE 0x10000
+#define CHUNK_SIZE  0x400
+
+// Randomised once per seed: RAM and the SFRs. Cases start from that image
+// with their own register banks, so only what a case touched has to be
+// put back.
+#define STATE_BASE RAM_BASE
+#define STATE_SIZE (MEM_SIZE - RAM_BASE)
+#define BANKS_BASE REG_BANK_ADDR(3)
+#define BANKS_SIZE (4 * REG_BANK_SIZE)
+
+// Instructions are placed below the end of code flash so the 8 byte
+// fetch window stays inside it
+#define PC_FIRST 0x0100
+#define PC_LAST  (CODE_FLASH_SIZE - 16)
+
+static const struct {
+    uint8_t map;
+    uint8_t code;
+    uint8_t mask;
+    void (*exec)(RL78_CPU* cpu, const RL78_Insn* insn);
+    uint8_t size;
+    uint8_t cycles;
+    const char* mnemonic;
+} rows[] = {
+#define OPCODE(map, code, mask, handler, size, cycles, mnemonic) { map, code, mask, handler, size, cycles, mnemonic },
+#include "opcodes.def"
+#undef OPCODE
+};
+
+#define ROW_COUNT (sizeof(rows) / sizeof(rows[0]))
+
+static const uint8_t map_prefix[MAP_COUNT] = { 0, 0x61, 0x71, 0x31 };
+
+// Opcode bytes that still decode to each row once later rows have
+// overridden it. Rows with none left are never executed.
+static uint8_t choices[ROW_COUNT][256];
+static uint16_t choice_count[ROW_COUNT];
+
+// Identifies a row by its contents rather than its position in the spec,
+// so its cases stay the same when other rows are added or removed
+static uint64_t row_key[ROW_COUNT];
+
+typedef struct {
+    RL78_CPU live; // Decodes every instruction from memory
+    RL78_CPU cached; // Runs from a predecode entry
+    RL78_Predecode predecode;
+    RL78_WriteLog live_log;
+    RL78_WriteLog cached_log;
+    uint8_t* base; // Window contents every case starts from
+    uint64_t seed;
+    uint64_t first;
+    uint64_t end;
+    int stride;
+    uint64_t digest[ROW_COUNT];
+    uint64_t mismatches;
+    uint64_t failed[CONFORMANCE_REPORTS];
+} Worker;
+
+static void build_choices(void)
+{
+    for (size_t r = 0; r < ROW_COUNT; r++) {
+        uint8_t id[3] = { rows[r].map, rows[r].code, rows[r].mask };
+        row_key[r] = fnv1a64((const uint8_t*)rows[r].mnemonic, strlen(rows[r].mnemonic),
+            fnv1a64(id, sizeof(id), FNV1A64_INIT));
+
+        choice_count[r] = 0;
+        for (int b = 0; b < 256; b++) {
+            if ((b & rows[r].mask) != rows[r].code || (rows[r].map == MAP_1ST && b == 0x11))
+                continue;
+            const RL78_Opcode* op = rows[r].map == MAP_1ST ? decode_bytes((uint8_t)b, 0)
+                : decode_bytes(map_prefix[rows[r].map], (uint8_t)b);
+            if (op->exec == rows[r].exec && op->size == rows[r].size && op->cycles == rows[r].cycles
+                && strcmp(op->mnemonic, rows[r].mnemonic) == 0)
+                choices[r][choice_count[r]++] = (uint8_t)b;
+        }
+    }
+}
+
+// splitmix64, so a case can be regenerated from its number alone
+static uint64_t next_random(uint64_t* state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static void set_state(RL78_CPU* cpu, const RL78_CPU* state)
+{
+    cpu->PC = state->PC;
+    cpu->SP = state->SP;
+    cpu->ES = state->ES;
+    cpu->CS = state->CS;
+    cpu->PSW = state->PSW;
+    cpu->ext_addressing = false;
+    cpu->halted = false;
+    cpu->cycles = 0;
+    sched_init(&cpu->sched);
+    flash_init(&cpu->flash);
+    cpu_sync_bank(cpu);
+}
+
+static bool same_state(const RL78_CPU* a, const RL78_CPU* b)
+{
+    return a->PC == b->PC && a->SP == b->SP && a->ES == b->ES && a->CS == b->CS
+        && a->PSW.asByte == b->PSW.asByte && a->halted == b->halted && a->cycles == b->cycles
+        && (uint8_t*)a->regs - a->memory == (uint8_t*)b->regs - b->memory
+        && a->sched.count == b->sched.count && a->sched.next == b->sched.next
+        && memcmp(&a->flash, &b->flash, sizeof(a->flash)) == 0;
+}
+
+static void report_case(const Worker* w, uint64_t n, size_t row, const uint8_t* code, int len, FILE* out)
+{
+    const RL78_CPU* a = &w->live;
+    const RL78_CPU* b = &w->cached;
+    fprintf(out, "case %llu of %s,", (unsigned long long)(n / ROW_COUNT), rows[row].mnemonic);
+    for (int i = 0; i < len; i++)
+        fprintf(out, " %02X", code[i]);
+    fprintf(out, "\n");
+    fprintf(out, "  live:   PC=%05X SP=%04X ES=%X CS=%X PSW=%02X cycles=%llu halted=%d\n", a->PC, a->SP, a->ES, a->CS,
+        a->PSW.asByte, (unsigned long long)a->cycles, a->halted);
+    fprintf(out, "  cached: PC=%05X SP=%04X ES=%X CS=%X PSW=%02X cycles=%llu halted=%d\n", b->PC, b->SP, b->ES, b->CS,
+        b->PSW.asByte, (unsigned long long)b->cycles, b->halted);
+    for (uint32_t i = 0; i < WINDOW_SIZE; i++) {
+        if (a->memory[WINDOW_BASE + i] != b->memory[WINDOW_BASE + i]) {
+            fprintf(out, "  memory differs from 0x%05X: %02X vs %02X\n", WINDOW_BASE + i,
+                a->memory[WINDOW_BASE + i], b->memory[WINDOW_BASE + i]);
+            break;
+        }
+    }
+}
+
+// Hash of one byte the case changed, zero if it didn't, and put it back
+// in both instances. Clears *same if they disagree.
+static uint64_t collect_byte(Worker* w, uint32_t addr, bool* same)
+{
+    uint8_t* live = &w->live.memory[addr];
+    uint8_t* cached = &w->cached.memory[addr];
+    uint8_t base = w->base[addr - WINDOW_BASE];
+    uint64_t hash = 0;
+    if (*live != *cached)
+        *same = false;
+    if (*live != base) {
+        uint8_t write[4] = { (uint8_t)addr, (uint8_t)(addr >> 8), (uint8_t)(addr >> 16), *live };
+        hash = fnv1a64(write, sizeof(write), FNV1A64_INIT);
+    }
+    *live = *cached = base;
+    return hash;
+}
+
+// Byte hashes are summed, so the order stores are visited in doesn't matter
+static uint64_t collect_log(Worker* w, const RL78_WriteLog* log, bool* same)
+{
+    uint64_t sum = 0;
+    for (int i = 0; i < log->count; i++) {
+        for (uint32_t addr = log->addr[i]; addr < log->addr[i] + log->len[i]; addr++) {
+            // Stores outside the window can only be to flash, which ignores them
+            if (addr >= WINDOW_BASE && addr < WINDOW_BASE + WINDOW_SIZE)
+                sum += collect_byte(w, addr, same);
+        }
+    }
+    return sum;
+}
+
+// Slow path for a store log that overflowed: compare the whole window
+static uint64_t collect_window(Worker* w, bool* same)
+{
+    uint8_t* live = &w->live.memory[WINDOW_BASE];
+    uint8_t* cached = &w->cached.memory[WINDOW_BASE];
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < WINDOW_SIZE; i += CHUNK_SIZE) {
+        if (memcmp(&live[i], &w->base[i], CHUNK_SIZE) == 0 && memcmp(&cached[i], &w->base[i], CHUNK_SIZE) == 0)
+            continue;
+        for (uint32_t j = i; j < i + CHUNK_SIZE; j++)
+            sum += collect_byte(w, WINDOW_BASE + j, same);
+    }
+    return sum;
+}
+
+// Hash the register banks and every byte the case stored, then return both
+// instances to the base image. Clears *same if they disagree.
+static uint64_t collect_writes(Worker* w, uint64_t hash, bool* same)
+{
+    // Handlers write registers directly, so the banks are never logged
+    if (memcmp(&w->live.memory[BANKS_BASE], &w->cached.memory[BANKS_BASE], BANKS_SIZE) != 0)
+        *same = false;
+    hash = fnv1a64(&w->live.memory[BANKS_BASE], BANKS_SIZE, hash);
+    memcpy(&w->live.memory[BANKS_BASE], &w->base[BANKS_BASE - WINDOW_BASE], BANKS_SIZE);
+    memcpy(&w->cached.memory[BANKS_BASE], &w->base[BANKS_BASE - WINDOW_BASE], BANKS_SIZE);
+
+    uint64_t sum;
+    if (w->live_log.overflow || w->cached_log.overflow)
+        sum = collect_window(w, same);
+    else
+        sum = collect_log(w, &w->live_log, same) + collect_log(w, &w->cached_log, same);
+    uint8_t bytes[8];
+    for (int i = 0; i < 8; i++)
+        bytes[i] = (uint8_t)(sum >> (8 * i));
+    return fnv1a64(bytes, sizeof(bytes), hash);
+}
+
+// Run case n, returning false on a mismatch. With out set, a mismatch is
+// described there. Cases are numbered across rows so every thread gets a
+// share of each, but a case is generated from its row's key and its index
+// within the row only.
+static bool run_case(Worker* w, uint64_t n, FILE* out)
+{
+    size_t row = n % ROW_COUNT;
+    if (choice_count[row] == 0)
+        return true;
+    uint64_t rng = w->seed ^ row_key[row] ^ (n / ROW_COUNT * 0xD1B54A32D192ED03ULL);
+
+    // Random state, applied to both instances
+    RL78_CPU state;
+    state.PC = PC_FIRST + next_random(&rng) % (PC_LAST - PC_FIRST);
+    state.SP = (uint16_t)next_random(&rng);
+    state.ES = next_random(&rng) & 1 ? 0x0F : 0x00;
+    state.CS = next_random(&rng) & 0x0F;
+    state.PSW.asByte = (uint8_t)next_random(&rng);
+    for (uint32_t i = 0; i < BANKS_SIZE; i += 8) {
+        uint64_t r = next_random(&rng);
+        memcpy(&w->live.memory[BANKS_BASE + i], &r, 8);
+        memcpy(&w->cached.memory[BANKS_BASE + i], &r, 8);
+    }
+
+    // Random encoding of the row: optional ES:, map prefix, opcode, then
+    // random operands and trailing bytes
+    uint8_t code[10];
+    uint64_t r0 = next_random(&rng), r1 = next_random(&rng);
+    memcpy(code, &r0, 8);
+    memcpy(code + 8, &r1, 2);
+    int len = 0;
+    if ((r1 >> 16) % 4 == 0)
+        code[len++] = 0x11;
+    if (rows[row].map != MAP_1ST)
+        code[len++] = map_prefix[rows[row].map];
+    code[len++] = choices[row][(r1 >> 24) % choice_count[row]];
+    len += rows[row].size - (rows[row].map != MAP_1ST) - 1;
+    memcpy(&w->live.memory[state.PC], code, sizeof(code));
+    memcpy(&w->cached.memory[state.PC], code, sizeof(code));
+
+    set_state(&w->live, &state);
+    set_state(&w->cached, &state);
+    w->live_log.count = w->cached_log.count = 0;
+    w->live_log.overflow = w->cached_log.overflow = false;
+
+    RL78_PredecodeEntry entry;
+    uint32_t at = predecode_insn(&w->cached, state.PC, &entry);
+    w->predecode.entries[at] = entry;
+
+    cpu_step(&w->live);
+    cpu_step(&w->cached);
+    w->predecode.entries[at].index = PREDECODE_NONE;
+
+    bool match = same_state(&w->live, &w->cached);
+    if (out && (!match || memcmp(&w->live.memory[WINDOW_BASE], &w->cached.memory[WINDOW_BASE], WINDOW_SIZE) != 0))
+        report_case(w, n, row, code, len, out);
+
+    const RL78_CPU* cpu = &w->live;
+    uint8_t regs[14] = { (uint8_t)cpu->PC, (uint8_t)(cpu->PC >> 8), (uint8_t)(cpu->PC >> 16),
+        (uint8_t)cpu->SP, (uint8_t)(cpu->SP >> 8), cpu->ES, cpu->CS, cpu->PSW.asByte, cpu->halted,
+        (uint8_t)cpu->cycles, (uint8_t)cpu->sched.count, cpu->flash.busy, cpu->flash.status, cpu->flash.command };
+    uint64_t hash = fnv1a64(regs, sizeof(regs), FNV1A64_INIT);
+    hash = collect_writes(w, hash, &match);
+    memset(&w->live.memory[state.PC], FLASH_ERASED, sizeof(code));
+    memset(&w->cached.memory[state.PC], FLASH_ERASED, sizeof(code));
+
+    // Summed so the digest doesn't depend on the order cases ran in.
+    // Reruns for a report are already counted.
+    if (out == NULL)
+        w->digest[row] += hash;
+    return match;
+}
+
+static void* run_worker(void* arg)
+{
+    Worker* w = arg;
+    for (uint64_t n = w->first; n < w->end; n += w->stride) {
+        if (!run_case(w, n, NULL)) {
+            if (w->mismatches < CONFORMANCE_REPORTS)
+                w->failed[w->mismatches] = n;
+            w->mismatches++;
+        }
+    }
+    return NULL;
+}
+
+static bool worker_init(Worker* w, uint64_t seed)
+{
+    memset(w, 0, sizeof(*w));
+    if (!cpu_init(&w->live) || !cpu_init(&w->cached))
+        return false;
+    w->seed = seed;
+    w->base = malloc(WINDOW_SIZE);
+    w->predecode.entries = malloc(CODE_FLASH_SIZE * sizeof(RL78_PredecodeEntry));
+    if (!w->base || !w->predecode.entries)
+        return false;
+    w->predecode.entry_count = CODE_FLASH_SIZE;
+    for (uint32_t i = 0; i < CODE_FLASH_SIZE; i++)
+        w->predecode.entries[i] = (RL78_PredecodeEntry){ PREDECODE_NONE, 0, 0 };
+    w->cached.predecode = &w->predecode;
+    w->live.write_log = &w->live_log;
+    w->cached.write_log = &w->cached_log;
+
+    // Every worker builds the same image from the seed
+    memcpy(w->base, &w->live.memory[WINDOW_BASE], WINDOW_SIZE);
+    uint64_t rng = seed;
+    for (uint32_t i = 0; i < STATE_SIZE; i += 8) {
+        uint64_t r = next_random(&rng);
+        memcpy(&w->base[STATE_BASE - WINDOW_BASE + i], &r, 8);
+    }
+    memcpy(&w->live.memory[WINDOW_BASE], w->base, WINDOW_SIZE);
+    memcpy(&w->cached.memory[WINDOW_BASE], w->base, WINDOW_SIZE);
+    return true;
+}
+
+static void worker_free(Worker* w)
+{
+    cpu_free(&w->live);
+    cpu_free(&w->cached);
+    free(w->base);
+    free(w->predecode.entries);
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+uint64_t conformance_run(uint64_t cases_per_row, uint64_t seed, int threads, FILE* out)
+{
+    if (cases_per_row > UINT64_MAX / ROW_COUNT) {
+        fprintf(stderr, "Too many conformance cases\n");
+        return cases_per_row;
+    }
+    uint64_t cases = cases_per_row * ROW_COUNT;
+#ifndef _WIN32
+    if (threads <= 0)
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#else
+    threads = 1;
+#endif
+    if (threads <= 0)
+        threads = 1;
+
+    Worker* workers = malloc(threads * sizeof(Worker));
+    if (workers == NULL)
+        return cases;
+    int ready = 0;
+    // cpu_init() builds the shared decode tables, so this stays on one thread
+    while (ready < threads && worker_init(&workers[ready], seed))
+        ready++;
+    if (ready < threads) {
+        fprintf(stderr, "Couldn't set up %d conformance workers\n", threads);
+        for (int t = 0; t <= ready && t < threads; t++)
+            worker_free(&workers[t]);
+        free(workers);
+        return cases;
+    }
+    build_choices();
+
+    double start = now_seconds();
+#ifndef _WIN32
+    pthread_t* ids = malloc(threads * sizeof(pthread_t));
+    bool* started = calloc(threads, sizeof(bool));
+    for (int t = 0; t < threads; t++) {
+        workers[t].first = t;
+        workers[t].end = cases;
+        workers[t].stride = threads;
+        if (t > 0 && ids && started)
+            started[t] = pthread_create(&ids[t], NULL, run_worker, &workers[t]) == 0;
+    }
+    // Shares whose thread couldn't be started run here instead
+    run_worker(&workers[0]);
+    for (int t = 1; t < threads; t++) {
+        if (started && started[t])
+            pthread_join(ids[t], NULL);
+        else
+            run_worker(&workers[t]);
+    }
+    free(ids);
+    free(started);
+#else
+    workers[0].end = cases;
+    workers[0].stride = 1;
+    run_worker(&workers[0]);
+#endif
+    double elapsed = now_seconds() - start;
+
+    uint64_t mismatches = 0;
+    for (int t = 0; t < threads; t++) {
+        mismatches += workers[t].mismatches;
+        if (t == 0)
+            continue;
+        for (size_t r = 0; r < ROW_COUNT; r++)
+            workers[0].digest[r] += workers[t].digest[r];
+    }
+
+    // Regenerate the first few failures to describe them
+    int reported = 0;
+    for (int t = 0; t < threads && reported < CONFORMANCE_REPORTS; t++) {
+        for (uint64_t i = 0; i < workers[t].mismatches && i < CONFORMANCE_REPORTS && reported < CONFORMANCE_REPORTS; i++, reported++)
+            run_case(&workers[threads - 1], workers[t].failed[i], stderr);
+    }
+
+    size_t shadowed = 0;
+    for (size_t r = 0; r < ROW_COUNT; r++) {
+        if (choice_count[r] == 0) {
+            fprintf(out, "%d:%02X/%02X shadowed         %s\n", rows[r].map, rows[r].code, rows[r].mask, rows[r].mnemonic);
+            shadowed++;
+        }
+        else
+            fprintf(out, "%d:%02X/%02X %016llx %s\n", rows[r].map, rows[r].code, rows[r].mask,
+                (unsigned long long)workers[0].digest[r], rows[r].mnemonic);
+    }
+    fprintf(stderr, "%llu cases over %zu rows (%zu shadowed) on %d threads in %.2fs, %.0f cases/s, %llu mismatches\n",
+        (unsigned long long)cases, ROW_COUNT, shadowed, threads, elapsed, elapsed > 0 ? cases / elapsed : 0.0,
+        (unsigned long long)mismatches);
+
+    for (int t = 0; t < threads; t++)
+        worker_free(&workers[t]);
+    free(workers);
+    return mismatches;
+}
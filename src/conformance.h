@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Mismatches reported in detail; the rest are only counted
+#define CONFORMANCE_REPORTS 8
+
+// Differential check of instruction semantics. Every opcode spec row gets
+// cases_per_row cases, each a random machine state plus a random encoding
+// of the row, executed through live decoding and through a predecode entry
+// produced by the scanner. Registers, PSW, memory writes, cycles and
+// peripheral state must match. Memory is compared at the register banks
+// and the addresses in each instance's write log. A case depends only on
+// the seed, its row's map, code, mask and mnemonic and its index within
+// the row, so results don't depend on the thread count or on other rows.
+//
+// A digest of each row's results is written to out, one line per row,
+// keyed by map:code/mask. Editing the spec only changes the lines of the
+// rows it touches, plus rows like SKH whose result depends on decoding the
+// instruction after them. The conformance test compares the output against
+// tests/conformance.digest, so a change in any instruction's behaviour
+// fails the build. Returns the number of mismatching cases.
+uint64_t conformance_run(uint64_t cases_per_row, uint64_t seed, int threads, FILE* out);
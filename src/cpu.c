@@ -1,256 +1,554 @@
 #include "cpu.h"
 #include "instructions.h"
+#include "predecode.h"
+#include "replay.h"
+#include "uart.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
 #define GET_LREG(cpu, idx) (cpu->GPR)
 
+// Decode tables, expanded from opcodes.def on first cpu_init()
+static const struct {
+    uint8_t map;
+    uint8_t code;
+    uint8_t mask;
+    RL78_Opcode op;
+} opcode_spec[] = {
+#define OPCODE(map, code, mask, handler, size, cycles, mnemonic) { map, code, mask, { handler, size, cycles, mnemonic } },
+#include "opcodes.def"
+#undef OPCODE
+};
+
+static RL78_Opcode decode_table[MAP_COUNT][256];
+
+static void build_decode_tables(void)
+{
+    static bool built = false;
+    if (built)
+        return;
+
+    for (size_t i = 0; i < sizeof(opcode_spec) / sizeof(opcode_spec[0]); i++) {
+        for (int b = 0; b < 256; b++) {
+            if ((b & opcode_spec[i].mask) == opcode_spec[i].code)
+                decode_table[opcode_spec[i].map][b] = opcode_spec[i].op;
+        }
+    }
+    built = true;
+}
+
+// Look up an opcode, following the 0x31 / 0x61 / 0x71 map prefixes.
+// Entries with a NULL exec are undefined opcodes.
+const RL78_Opcode* decode_bytes(uint8_t opcode_1st, uint8_t opcode_2nd)
+{
+    switch (opcode_1st) {
+    case 0x31: return &decode_table[MAP_4TH][opcode_2nd];
+    case 0x61: return &decode_table[MAP_2ND][opcode_2nd];
+    case 0x71: return &decode_table[MAP_3RD][opcode_2nd];
+    default:   return &decode_table[MAP_1ST][opcode_1st];
+    }
+}
+
+// Flat decode table slot, stable for a given opcode spec
+uint16_t decode_index(const RL78_Opcode* op)
+{
+    return (uint16_t)(op - &decode_table[0][0]);
+}
+
+const RL78_Opcode* decode_entry(uint16_t index)
+{
+    return &decode_table[0][0] + index;
+}
+
+// Fingerprint of opcodes.def, so cached decode indices from another build
+// are never trusted
+uint64_t decode_spec_hash(void)
+{
+    uint64_t hash = FNV1A64_INIT;
+    for (size_t i = 0; i < sizeof(opcode_spec) / sizeof(opcode_spec[0]); i++) {
+        uint8_t row[5] = { opcode_spec[i].map, opcode_spec[i].code, opcode_spec[i].mask,
+            opcode_spec[i].op.size, opcode_spec[i].op.cycles };
+        hash = fnv1a64(row, sizeof(row), hash);
+        hash = fnv1a64((const uint8_t*)opcode_spec[i].op.mnemonic, strlen(opcode_spec[i].op.mnemonic), hash);
+    }
+    return hash;
+}
+
+static const RL78_Opcode* decode(const RL78_CPU* cpu, uint32_t addr20)
+{
+    return decode_bytes(cpu->memory[addr20 & PC_MASK], cpu->memory[(addr20 + 1) & PC_MASK]);
+}
+
 // Convert short addresses to absolute
 static uint32_t saddr_to_absolute(uint8_t saddr)
 {
-    return 0xFE20 + saddr; // Map 0x00–0xDF to 0xFE20–0xFEFF
+    // Map 0x20-0xFF to 0xFFE20-0xFFEFF and 0x00-0x1F to 0xFFF00-0xFFF1F
+    return saddr >= 0x20 ? 0xFFE00 + saddr : 0xFFF00 + saddr;
+}
+
+// SFRs that are modelled as CPU fields instead of memory
+static uint8_t sfr_read(RL78_CPU* cpu, uint8_t code)
+{
+    switch (code)
+    {
+    case 0xF8:
+        return (uint8_t)cpu->SP;
+    case 0xF9:
+        return (uint8_t)(cpu->SP >> 8);
+    case 0xFA:
+        return cpu->PSW.asByte;
+    case 0xFC:
+        return cpu->CS;
+    case 0xFD:
+        return cpu->ES;
+    case 0x10:
+    case 0x12:
+        if (cpu->uart)
+            return uart_read(cpu->uart, cpu, SFR_BASE + code);
+        return cpu->memory[SFR_BASE + code];
+    default:
+        return cpu->memory[SFR_BASE + code];
+    }
+}
+
+static void sfr_write(RL78_CPU* cpu, uint8_t code, uint8_t data)
+{
+    switch (code)
+    {
+    case 0xF8:
+        cpu->SP = (cpu->SP & 0xFF00) | data;
+        break;
+    case 0xF9:
+        cpu->SP = (cpu->SP & 0x00FF) | (data << 8);
+        break;
+    case 0xFA:
+        cpu->PSW.asByte = data;
+        cpu_sync_bank(cpu);
+        break;
+    case 0xFC:
+        cpu->CS = data & 0x0F;
+        break;
+    case 0xFD:
+        cpu->ES = data & 0x0F;
+        break;
+    case 0x10:
+    case 0x12:
+        if (cpu->uart)
+            uart_write(cpu->uart, cpu, SFR_BASE + code, data);
+        else
+            cpu->memory[SFR_BASE + code] = data;
+        break;
+    default:
+        cpu->memory[SFR_BASE + code] = data;
+        break;
+    }
+}
+
+static inline int mem_region(uint32_t addr20)
+{
+    if (addr20 >= RAM_BASE)
+        return STAT_MEM_RAM;
+    if (IS_CODE_FLASH(addr20) || IS_DATA_FLASH(addr20))
+        return STAT_MEM_FLASH;
+    return STAT_MEM_OTHER;
+}
+
+// Peripheral registers in the 2nd SFR area
+static uint8_t sfr2_read(RL78_CPU* cpu, uint32_t addr20)
+{
+    if (cpu->uart && uart_owns(addr20))
+        return uart_read(cpu->uart, cpu, addr20);
+    if (flash_owns(addr20))
+        return flash_read(&cpu->flash, cpu, addr20);
+    return cpu->memory[addr20];
+}
+
+static void sfr2_write(RL78_CPU* cpu, uint32_t addr20, uint8_t data)
+{
+    if (cpu->uart && uart_owns(addr20))
+        uart_write(cpu->uart, cpu, addr20, data);
+    else if (flash_owns(addr20))
+        flash_write(&cpu->flash, cpu, addr20, data);
+    else
+        cpu->memory[addr20] = data;
+}
+
+uint8_t read8_abs(RL78_CPU* cpu, uint32_t addr20)
+{
+    addr20 &= 0xFFFFF;
+    if (addr20 >= SFR_BASE) {
+        STAT_INC(cpu, mem[STAT_MEM_SFR]);
+        return sfr_read(cpu, addr20 - SFR_BASE);
+    }
+    if (addr20 >= SFR2_BASE && addr20 < SFR2_END) {
+        STAT_INC(cpu, mem[STAT_MEM_SFR]);
+        return sfr2_read(cpu, addr20);
+    }
+    STAT_INC(cpu, mem[mem_region(addr20)]);
+    return cpu->memory[addr20];
 }
 
 uint8_t read8(RL78_CPU* cpu, uint16_t addr16)
 {
     // Resolve full 1 MB address if we want ES-prefixed address
-    uint32_t full_addr = cpu->ext_addressing ? ((uint32_t)(cpu->ES) << 16) | addr16 : addr16;
-    full_addr &= 0xFFFFF;  // Mask to 20-bit address
-    return cpu->memory[full_addr];
+    uint32_t full_addr = cpu->ext_addressing ? ((uint32_t)(cpu->ES) << 16) | addr16 : addr16 | 0xF0000;
+    return read8_abs(cpu, full_addr);
 }
 
 uint8_t read8_indir(RL78_CPU* cpu, uint16_t addr16)
 {
+    STAT_INC(cpu, mem[STAT_MEM_INDIRECT]);
     // Resolve full 1 MB address if we want ES-prefixed address
-    uint32_t full_addr = cpu->ext_addressing ? ((uint32_t)(cpu->ES) << 16) | addr16 : addr16 | 0xF0000; 
-    full_addr &= 0xFFFFF;  // Mask to 20-bit address
-    return cpu->memory[full_addr];
+    uint32_t full_addr = cpu->ext_addressing ? ((uint32_t)(cpu->ES) << 16) | addr16 : addr16 | 0xF0000;
+    return read8_abs(cpu, full_addr);
 }
 
 uint8_t read8_saddr(RL78_CPU* cpu, uint8_t saddr)
 {
-    return cpu->memory[saddr_to_absolute(saddr)];
+    STAT_INC(cpu, mem[STAT_MEM_SADDR]);
+    return read8_abs(cpu, saddr_to_absolute(saddr));
+}
+
+uint8_t read8_sfr(RL78_CPU* cpu, uint8_t code)
+{
+    STAT_INC(cpu, mem[STAT_MEM_SFR]);
+    return sfr_read(cpu, code);
+}
+
+void cpu_note_write(RL78_CPU* cpu, uint32_t addr20, uint32_t len)
+{
+    if (cpu->replay)
+        replay_note_write(cpu->replay, cpu, addr20, len);
+    RL78_WriteLog* log = cpu->write_log;
+    if (log) {
+        if (log->count < WRITE_LOG_SIZE) {
+            log->addr[log->count] = addr20;
+            log->len[log->count++] = (uint16_t)len;
+        }
+        else
+            log->overflow = true;
+    }
+}
+
+void write8_abs(RL78_CPU* cpu, uint32_t addr20, uint8_t data)
+{
+    addr20 &= 0xFFFFF;
+    NOTE_WRITE(cpu, addr20, 1);
+    if (addr20 >= SFR_BASE) {
+        STAT_INC(cpu, mem[STAT_MEM_SFR]);
+        sfr_write(cpu, addr20 - SFR_BASE, data);
+        return;
+    }
+    if (addr20 >= SFR2_BASE && addr20 < SFR2_END) {
+        STAT_INC(cpu, mem[STAT_MEM_SFR]);
+        sfr2_write(cpu, addr20, data);
+        return;
+    }
+    STAT_INC(cpu, mem[mem_region(addr20)]);
+    if (IS_CODE_FLASH(addr20) || IS_DATA_FLASH(addr20))
+        return; // Flash only changes through the sequencer
+    cpu->memory[addr20] = data;
 }
 
 void write8(RL78_CPU* cpu, uint16_t addr16, uint8_t data)
 {
     // Resolve full 1 MB address if we want ES-prefixed address
-    uint32_t full_addr = cpu->ext_addressing ? ((uint32_t)(cpu->ES) << 16) | addr16 : addr16;
-    full_addr &= 0xFFFFF;  // Mask to 20-bit address
-    cpu->memory[full_addr] = data;
+    uint32_t full_addr = cpu->ext_addressing ? ((uint32_t)(cpu->ES) << 16) | addr16 : addr16 | 0xF0000;
+    write8_abs(cpu, full_addr, data);
 }
 
 void write8_indir(RL78_CPU* cpu, uint16_t addr16, uint8_t data)
 {
+    STAT_INC(cpu, mem[STAT_MEM_INDIRECT]);
     // Resolve full 1 MB address if we want ES-prefixed address
     uint32_t full_addr = cpu->ext_addressing ? ((uint32_t)(cpu->ES) << 16) | addr16 : addr16 | 0xF0000;
-    full_addr &= 0xFFFFF;  // Mask to 20-bit address
-    cpu->memory[full_addr] = data;
+    write8_abs(cpu, full_addr, data);
 }
 
 void write8_saddr(RL78_CPU* cpu, uint8_t saddr, uint8_t data)
 {
-    cpu->memory[saddr_to_absolute(saddr)] = data;
+    STAT_INC(cpu, mem[STAT_MEM_SADDR]);
+    write8_abs(cpu, saddr_to_absolute(saddr), data);
 }
 
-// Fetch instruction opcode/operands, increments PC
-uint8_t fetch8(RL78_CPU* cpu)
+void write8_sfr(RL78_CPU* cpu, uint8_t code, uint8_t data)
 {
-    uint8_t byte = cpu->memory[GET_PC(cpu)];
-    INC_PC(cpu, 1);
-    return byte;
+    STAT_INC(cpu, mem[STAT_MEM_SFR]);
+    NOTE_WRITE(cpu, SFR_BASE + code, 1);
+    sfr_write(cpu, code, data);
 }
 
-uint16_t fetch16(RL78_CPU* cpu)
+uint16_t read16(RL78_CPU* cpu, uint16_t addr16)
 {
-    uint8_t low = fetch8(cpu);
-    uint8_t high = fetch8(cpu);
-    return (high << 8) | low;
+    addr16 &= 0xFFFE;
+    return read8(cpu, addr16) | (read8(cpu, addr16 + 1) << 8);
 }
 
-uint8_t* get_sfr(RL78_CPU* cpu,  uint8_t code)
+uint16_t read16_saddr(RL78_CPU* cpu, uint8_t saddr)
 {
-    switch (code)
-    {
-    case 0xFA:
-        return &cpu->PSW.asByte;
-    case 0xFC:
-        return &cpu->CS;
-    case 0xFD:
-        return &cpu->ES;
-    default:
-        break;
+    saddr &= 0xFE;
+    return read8_saddr(cpu, saddr) | (read8_saddr(cpu, saddr + 1) << 8);
+}
+
+uint16_t read16_sfr(RL78_CPU* cpu, uint8_t code)
+{
+    STAT_ADD(cpu, mem[STAT_MEM_SFR], 2);
+    code &= 0xFE;
+    return sfr_read(cpu, code) | (sfr_read(cpu, code + 1) << 8);
+}
+
+void write16(RL78_CPU* cpu, uint16_t addr16, uint16_t data)
+{
+    addr16 &= 0xFFFE;
+    write8(cpu, addr16, (uint8_t)data);
+    write8(cpu, addr16 + 1, (uint8_t)(data >> 8));
+}
+
+void write16_saddr(RL78_CPU* cpu, uint8_t saddr, uint16_t data)
+{
+    saddr &= 0xFE;
+    write8_saddr(cpu, saddr, (uint8_t)data);
+    write8_saddr(cpu, saddr + 1, (uint8_t)(data >> 8));
+}
+
+void write16_sfr(RL78_CPU* cpu, uint8_t code, uint16_t data)
+{
+    STAT_ADD(cpu, mem[STAT_MEM_SFR], 2);
+    code &= 0xFE;
+    NOTE_WRITE(cpu, SFR_BASE + code, 2);
+    sfr_write(cpu, code, (uint8_t)data);
+    sfr_write(cpu, code + 1, (uint8_t)(data >> 8));
+}
+
+// Load the instruction window at addr20 with one unaligned read. Near the
+// top of the 1 MB space the window wraps, so fall back to byte reads there.
+static uint64_t fetch_window(const RL78_CPU* cpu, uint32_t addr20)
+{
+    uint64_t window = 0;
+    if (addr20 <= MEM_SIZE - sizeof(window)) {
+        memcpy(&window, &cpu->memory[addr20], sizeof(window));
+    }
+    else {
+        for (int i = 0; i < (int)sizeof(window); i++)
+            window |= (uint64_t)cpu->memory[(addr20 + i) & PC_MASK] << (8 * i);
     }
+    return window;
 }
 
-void cpu_init(RL78_CPU* cpu)
+// Length of the instruction at addr20 including an ES: prefix.
+// Undefined opcodes count as one byte.
+uint8_t cpu_insn_size(const RL78_CPU* cpu, uint32_t addr20)
 {
+    uint8_t prefix = 0;
+    if (cpu->memory[addr20 & PC_MASK] == 0x11) {
+        prefix = 1;
+        addr20++;
+    }
+    const RL78_Opcode* op = decode(cpu, addr20);
+    return prefix + (op->exec ? op->size : 1);
+}
+
+// Render the instruction at addr20 from its mnemonic template in opcodes.def
+void disassemble(const RL78_CPU* cpu, uint32_t addr20, char* buf, int size)
+{
+    static const struct {
+        const char* token;
+        uint8_t bytes;
+    } operands[] = {
+        { "!!addr20", 3 }, { "$!addr20", 2 }, { "$addr20", 1 }, { "!addr16", 2 },
+        { "saddrp", 1 }, { "saddr", 1 }, { "sfrp", 1 }, { "sfr", 1 },
+        { "word", 2 }, { "byte", 1 },
+    };
+    int len = 0;
+
+    if (cpu->memory[addr20 & PC_MASK] == 0x11) {
+        len = snprintf(buf, size, "ES: ");
+        addr20++;
+    }
+
+    const RL78_Opcode* op = decode(cpu, addr20);
+    if (op->exec == NULL) {
+        snprintf(buf + len, size - len, "DB 0x%02X", cpu->memory[addr20 & PC_MASK]);
+        return;
+    }
+
+    uint8_t opcode_1st = cpu->memory[addr20 & PC_MASK];
+    uint8_t opcode_2nd = cpu->memory[(addr20 + 1) & PC_MASK];
+    bool prefixed = opcode_1st == 0x31 || opcode_1st == 0x61 || opcode_1st == 0x71;
+    uint32_t next = addr20 + op->size;
+    uint32_t pos = addr20 + (prefixed ? 2 : 1);
+
+    for (const char* m = op->mnemonic; *m && len < size - 1; ) {
+        bool matched = false;
+        for (size_t i = 0; i < sizeof(operands) / sizeof(operands[0]); i++) {
+            size_t tlen = strlen(operands[i].token);
+            if (strncmp(m, operands[i].token, tlen) != 0)
+                continue;
+
+            uint32_t value = 0;
+            for (int b = 0; b < operands[i].bytes; b++)
+                value |= (uint32_t)cpu->memory[(pos + b) & PC_MASK] << (8 * b);
+            pos += operands[i].bytes;
+
+            int width = operands[i].bytes * 2;
+            if (m[0] == '$') {
+                value = (next + (operands[i].bytes == 1 ? (int8_t)value : (int16_t)value)) & PC_MASK;
+                width = 5;
+            }
+
+            // Keep the !, !! and $ addressing marks in front of the value
+            int marks = (int)strspn(m, "!$");
+            len += snprintf(buf + len, size - len, "%.*s0x%0*X", marks, m, width, value);
+            m += tlen;
+            matched = true;
+            break;
+        }
+        if (matched)
+            continue;
+
+        if (strncmp(m, ".n", 2) == 0) {
+            len += snprintf(buf + len, size - len, ".%d", (opcode_2nd >> 4) & 0x07);
+            m += 2;
+        }
+        else if (strncmp(m, "cnt", 3) == 0) {
+            len += snprintf(buf + len, size - len, "%d", opcode_2nd >> 4);
+            m += 3;
+        }
+        else {
+            buf[len++] = *m++;
+            buf[len] = '\0';
+        }
+    }
+}
+
+// Point regs at the bank selected by PSW.RBS0/RBS1.
+// Must be called whenever PSW is written.
+void cpu_sync_bank(RL78_CPU* cpu)
+{
+    uint8_t bank = (cpu->PSW.RBS1 << 1) | cpu->PSW.RBS0;
+    cpu->regs = (GPR_u*)&cpu->memory[REG_BANK_ADDR(bank)];
+}
+
+// Returns false if the guest memory can't be allocated
+bool cpu_init(RL78_CPU* cpu)
+{
+    build_decode_tables();
+
     cpu->PC = 0x0000;
     cpu->SP = 0xf0000;  // "reset signal generation makes the SP contents undefined" manual pg. 11
     cpu->PSW.asByte = 0x06;
     cpu->ES = 0x0F;
     cpu->CS = 0x00;
     cpu->ext_addressing = false;
+    cpu->halted = false;
+    cpu->cycles = 0;
+    sched_init(&cpu->sched);
+    flash_init(&cpu->flash);
+    cpu->uart = NULL;
+    cpu->predecode = NULL;
+    cpu->replay = NULL;
+    cpu->write_log = NULL;
+    memset(&cpu->stats, 0, sizeof(cpu->stats));
+
+    // Zero filled, which also clears the general purpose registers.
+    // Untouched pages are never committed.
+#ifndef _WIN32
+    cpu->memory = mmap(NULL, MEM_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (cpu->memory == MAP_FAILED)
+        cpu->memory = NULL;
+#else
+    cpu->memory = calloc(MEM_SIZE, 1);
+#endif
+    if (cpu->memory == NULL)
+        return false;
+    memset(&cpu->memory[CODE_FLASH_BASE], FLASH_ERASED, CODE_FLASH_SIZE);
+    memset(&cpu->memory[DATA_FLASH_BASE], FLASH_ERASED, DATA_FLASH_SIZE);
+    cpu_sync_bank(cpu);
+    return true;
+}
 
-    memset(cpu->regs.R, 0, sizeof(cpu->regs.R)); // set general purpose registers to 0
-    memset(cpu->memory, 0, MEM_SIZE);
+void cpu_free(RL78_CPU* cpu)
+{
+    if (cpu->memory == NULL)
+        return;
+#ifndef _WIN32
+    munmap(cpu->memory, MEM_SIZE);
+#else
+    free(cpu->memory);
+#endif
+    cpu->memory = NULL;
 }
 
 void cpu_step(RL78_CPU* cpu)
 {
-    uint8_t opcode_1st = read8(cpu, GET_PC(cpu));
-    uint8_t opcode_2nd = read8(cpu, GET_PC(cpu) + 1);
+    if (cpu->halted)
+        return;
+
+    uint32_t pc = GET_PC(cpu);
+    uint64_t window = fetch_window(cpu, pc);
 
     // Handle instructions with ES:
-    // Note: 
+    // Note:
     // - using the ES: prefix adds EXACTLY ONE additional cycle to the base instruction's execution time
-    if (opcode_1st == 0x11) {
-        INC_PC(cpu, 1);
-        opcode_1st = read8(cpu, GET_PC(cpu));
-        opcode_2nd = read8(cpu, GET_PC(cpu) + 1);
+    // - it is charged after the handler, so cycles holds the instruction
+    //   start while it runs
+    uint8_t prefix_cycles = 0;
+    if ((uint8_t)window == 0x11) {
+        window >>= 8;
+        pc = (pc + 1) & PC_MASK;
         cpu->ext_addressing = true;
+        prefix_cycles = 1;
+        STAT_INC(cpu, es_prefix);
     }
 
-    switch (opcode_1st) {
-        case 0x00: nop_inst(cpu); break;
-        case 0x08: xch_a_r(cpu); break;
-        case 0x0C: add_a_imm8(cpu); break;
-        // 0x11: Extended addressing
-        case 0x12: movw_rp_ax(cpu); break;
-        case 0x13: movw_ax_rp(cpu); break;
-        case 0x14: movw_rp_ax(cpu); break;
-        case 0x15: movw_ax_rp(cpu); break;
-        case 0x16: movw_rp_ax(cpu); break;
-        case 0x17: movw_ax_rp(cpu); break;
-        case 0x19: mov_based_r_imm8(cpu); break;
-        case 0x30: movw_rp_imm16(cpu); break;
-        case 0x32: movw_rp_imm16(cpu); break;
-        case 0x33: xchw_ax_rp(cpu); break;
-        case 0x34: movw_rp_imm16(cpu); break;
-        case 0x35: xchw_ax_rp(cpu); break;
-        case 0x36: movw_rp_imm16(cpu); break;
-        case 0x37: xchw_ax_rp(cpu); break;
-        case 0x38: mov_based_r_imm8(cpu); break;
-        case 0x39: mov_based_bc_imm8(cpu); break;
-
-        case 0x41: mov_es_imm8(cpu);
-
-        case 0x50:
-        case 0x51:
-        case 0x52:
-        case 0x53:
-        case 0x54:
-        case 0x55:
-        case 0x56:
-        case 0x57: mov_r_imm8(cpu); break;
-        
-        case 0x61:
-            switch (opcode_2nd) {
-
-                case 0x08: add_a_r(cpu); break;
-                case 0x0A:
-                case 0x0B:
-                case 0x0C:
-                case 0x0D:
-                case 0x0E:
-                case 0x0F: add_a_r(cpu); break;
-
-                case 0xCB: br_ax(cpu); break;
-                case 0xC9: mov_a_indir_hl_plus_r(cpu); break;
-                case 0xD9: mov_indir_hl_plus_r_a(cpu); break;
-                case 0xE9: mov_a_indir_hl_plus_r(cpu); break;
-                case 0xF9: mov_indir_hl_plus_r_a(cpu); break;
-                case 0x8A:
-                case 0x8B:
-                case 0x8C:
-                case 0x8D:
-                case 0x8E:
-                case 0x8F: xch_a_r(cpu); break;
-
-                case 0xB8: mov_es_saddr(cpu); break;
-            }
-            break;
+    RL78_Insn insn;
+    memcpy(insn.op, &window, sizeof(insn.op));
 
-        case 0x60:
-        case 0x62:
-        case 0x63:
-        case 0x64:
-        case 0x65:
-        case 0x66:
-        case 0x67: mov_a_r(cpu); break;
-
-        case 0x70:
-        case 0x72:
-        case 0x73:
-        case 0x74:
-        case 0x75:
-        case 0x76:
-        case 0x77: mov_r_a(cpu); break;
-
-        case 0x80:
-        case 0x81:
-        case 0x82:
-        case 0x83:
-        case 0x84:
-        case 0x85:
-        case 0x86:
-        case 0x87: inc_r(cpu); break;
-        
-        case 0x89: mov_a_indir_rp(cpu); break;
-        case 0x8A: mov_a_indir_rp_offset(cpu); break;
-        case 0x8B: mov_a_indir_rp(cpu); break;
-        case 0x8C: mov_a_indir_rp_offset(cpu); break;
-
-        case 0x8D: mov_r_saddr(cpu); break;
-
-
-        // MOV A, sfr
-        case 0x8E: mov_a_sfr(cpu); break;
-        
-        case 0x8F: mov_r_addr16(cpu); break;
-        
-        case 0x99: mov_indir_rp_a(cpu); break;
-        case 0x9A: mov_indir_rp_offset_a(cpu); break;
-        case 0x9B: mov_indir_rp_a(cpu); break;
-        case 0x9C: mov_indir_rp_offset_a(cpu); break;
-        case 0x9D: mov_saddr_a(cpu); break;
-        case 0x9E: mov_sfr_a(cpu);
-
-        case 0xCA: mov_indir_rp_offset_imm8(cpu); break;
-        case 0xCC: mov_indir_rp_offset_imm8(cpu); break;
-        case 0xCD: mov_saddr_imm8(cpu); break;
-        case 0xCE: mov_sfr_imm8(cpu); break;
-        case 0xCF: mov_addr16_imm8(cpu); break;
-        
-        case 0xD8: mov_r_saddr(cpu); break;
-        case 0xD9: mov_r_addr16(cpu); break;
-
-        case 0xE0:
-        case 0xE1:
-        case 0xE2:
-        case 0xE3: oneb_r(cpu); break;
-
-        case 0xE6:
-        case 0xE7: onew_rp(cpu); break;
-        case 0xE8: mov_r_saddr(cpu); break;
-        case 0xE9: mov_r_addr16(cpu); break;
-
-        case 0xF0:
-        case 0xF1:
-        case 0xF2:
-        case 0xF3: clrb_r(cpu); break;
-
-        case 0xF6:
-        case 0xF7: clrw_rp(cpu); break;
-        case 0xF8: mov_r_saddr(cpu); break;
-        case 0xF9: mov_r_addr16(cpu); break;
-
-        default:
-            printf("Unknown opcode: 0x%02X at PC=0x%04X\n", opcode_1st, GET_PC(cpu));
-            break;
+    const RL78_Opcode* op;
+    const RL78_PredecodeEntry* pre = cpu->predecode && pc < cpu->predecode->entry_count ? &cpu->predecode->entries[pc] : NULL;
+    if (pre && pre->index != PREDECODE_NONE) {
+        op = decode_entry(pre->index);
+        STAT_INC(cpu, decode_hits);
+    }
+    else {
+        op = decode_bytes(insn.op[0], insn.op[1]);
+        STAT_INC(cpu, decode_misses);
+    }
+    if (op->exec == NULL) {
+        // Nothing after an undefined opcode can be trusted, so stop here.
+        // The cycle keeps run loops moving towards their deadline.
+        printf("Unknown opcode: 0x%02X 0x%02X at PC=0x%04X\n", insn.op[0], insn.op[1], pc);
+        SET_PC(cpu, pc);
+        cpu->cycles += 1 + prefix_cycles;
+        cpu->halted = true;
+    }
+    else {
+        // PC moves once per instruction, handlers see the next instruction address
+        SET_PC(cpu, pc + op->size);
+        op->exec(cpu, &insn);
+        cpu->cycles += op->cycles + prefix_cycles;
+        STAT_INC(cpu, opcode[insn.op[0]]);
+        if (insn.op[0] == 0x61)
+            STAT_INC(cpu, opcode_61[insn.op[1]]);
     }
     cpu->ext_addressing = false;
-    dump_cpu_state(cpu);
+}
+
+// Execute until the cycle counter reaches `until` or the CPU halts, firing
+// scheduled events as their deadlines pass
+void cpu_run(RL78_CPU* cpu, uint64_t until)
+{
+    while (!cpu->halted && cpu->cycles < until) {
+        uint64_t deadline = sched_next(&cpu->sched, until);
+        while (!cpu->halted && cpu->cycles < deadline)
+            cpu_step(cpu);
+        sched_run_due(&cpu->sched, cpu);
+    }
 }
 
 void dump_cpu_state(const RL78_CPU* cpu)
@@ -259,13 +557,15 @@ void dump_cpu_state(const RL78_CPU* cpu)
     printf("PC:     0x%04X\n", cpu->PC);
     printf("SP:     0x%04X\n", cpu->SP);
     printf("PSW:    0x%02X\n", cpu->PSW.asByte);
+    printf("RB:     %d\n", (cpu->PSW.RBS1 << 1) | cpu->PSW.RBS0);
+    printf("CYCLES: %llu\n", (unsigned long long)cpu->cycles);
     // general purpose regs
     for (int i = 0; i < 8; i++) {
-        printf("R%d:    0x%02X\n", i, cpu->regs.R[i]);
+        printf("R%d:    0x%02X\n", i, cpu->regs->R[i]);
     }
     // register pairs
     for (int i = 0; i < 4; i++) {
-        printf("RP%d:   0x%04X\n", i, cpu->regs.RP[i]);
+        printf("RP%d:   0x%04X\n", i, cpu->regs->RP[i]);
     }
 
     printf("----------------------\n");
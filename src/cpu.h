@@ -3,8 +3,12 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "sched.h"
+#include "flash.h"
+#include "stats.h"
+
 #define MEM_SIZE 0x100000 //  1MB address space 
-#define RAM_SIZE 512
+#define RAM_SIZE 0x1000 // 4 KB, ending just below the SFRs
 #define ROM_SIZE 4096
 
 // Macros to mask program counter to 20 bits
@@ -13,14 +17,28 @@
 #define SET_PC(cpu,x)  ((cpu)->PC = ((x) & PC_MASK))
 #define INC_PC(cpu,n)  ((cpu)->PC = ((cpu)->PC + (n)) & PC_MASK)
 
+// General purpose register banks live in RAM at 0xFFEE0-0xFFEFF.
+// Bank 0 is the highest (0xFFEF8), bank 3 the lowest (0xFFEE0).
+#define REG_BANK_BASE  0xFFEF8
+#define REG_BANK_SIZE  8
+#define REG_BANK_ADDR(n) (REG_BANK_BASE - (n) * REG_BANK_SIZE)
+
+// Special function registers occupy 0xFFF00-0xFFFFF, the 2nd SFR area
+// 0xF0000-0xF07FF
+#define SFR_BASE 0xFFF00
+#define SFR2_BASE 0xF0000
+#define SFR2_END  0xF0800
+
+#define RAM_BASE (SFR_BASE - RAM_SIZE)
+
 typedef union {
     struct {
         uint8_t CY : 1; // Carry flag
         uint8_t ISP0 : 1; // In-service priority flag
         uint8_t ISP1 : 1; // In-service priority flag
-        uint8_t unused1 : 1;
+        uint8_t RBS0 : 1; // Register bank select flag
         uint8_t AC : 1; // Auxiliary carry flag
-        uint8_t unused2 : 1;
+        uint8_t RBS1 : 1; // Register bank select flag
         uint8_t Z : 1; // Zero flag
         uint8_t IE : 1; //interrupt enable flag
     };
@@ -32,29 +50,69 @@ typedef union {
     uint16_t RP[4];
 } GPR_u;
 
+// Stores seen since the log was last cleared, for callers that need to
+// know what an instruction wrote. Stores past the end only set overflow.
+#define WRITE_LOG_SIZE 32
 typedef struct {
+    uint32_t addr[WRITE_LOG_SIZE];
+    uint16_t len[WRITE_LOG_SIZE];
+    int count;
+    bool overflow;
+} RL78_WriteLog;
+
+typedef struct RL78_CPU {
     uint32_t PC; // Program counter (masked to 20 bits with macros)
     uint16_t SP; // Stack pointer
     uint8_t ES; // Extra segment register
     uint8_t CS;  // Code segment register
     PSW_u PSW; // Program status word
-    GPR_u regs;  // 4 x 16-bit general pupose register pairs (8 x 8 bit GPRs)
+    GPR_u* regs;  // Active register bank, points into memory (4 x 16-bit pairs / 8 x 8 bit GPRs)
     bool ext_addressing; // When opcode 0x11 is encountered, this is set to true. 
-    uint8_t memory[MEM_SIZE]; // 1 MB address space
+    bool halted; // Set by HALT / STOP
+    uint64_t cycles; // Elapsed CPU clock cycles
+    RL78_Sched sched; // Pending peripheral events
+    RL78_Flash flash; // Flash sequencer
+    RL78_Stats stats; // Event counters for this instance
+    struct SAU_UART* uart; // NULL when no UART is attached
+    struct RL78_Predecode* predecode; // Decoded code flash, NULL when disabled
+    struct RL78_Replay* replay; // Checkpoints for reverse execution, NULL when disabled
+    RL78_WriteLog* write_log; // NULL when not recording stores
+    uint8_t* memory; // 1 MB address space, page aligned so flash files can be mapped over it
 } RL78_CPU;
 
+uint8_t read8_abs(RL78_CPU* cpu, uint32_t addr20);
 uint8_t read8(RL78_CPU* cpu, uint16_t addr16);
 uint8_t read8_indir(RL78_CPU* cpu, uint16_t addr16);
 uint8_t read8_saddr(RL78_CPU* cpu, uint8_t saddr);
+uint8_t read8_sfr(RL78_CPU* cpu, uint8_t code);
 
+void write8_abs(RL78_CPU* cpu, uint32_t addr20, uint8_t data);
 void write8(RL78_CPU* cpu, uint16_t addr16, uint8_t data);
 void write8_indir(RL78_CPU* cpu, uint16_t addr16, uint8_t data);
 void write8_saddr(RL78_CPU* cpu, uint8_t saddr, uint8_t data);
+void write8_sfr(RL78_CPU* cpu, uint8_t code, uint8_t data);
+
+// Word accesses ignore the lowest address bit
+uint16_t read16(RL78_CPU* cpu, uint16_t addr16);
+uint16_t read16_saddr(RL78_CPU* cpu, uint8_t saddr);
+uint16_t read16_sfr(RL78_CPU* cpu, uint8_t code);
+
+void write16(RL78_CPU* cpu, uint16_t addr16, uint16_t data);
+void write16_saddr(RL78_CPU* cpu, uint8_t saddr, uint16_t data);
+void write16_sfr(RL78_CPU* cpu, uint8_t code, uint16_t data);
+
+uint8_t cpu_insn_size(const RL78_CPU* cpu, uint32_t addr20);
+void disassemble(const RL78_CPU* cpu, uint32_t addr20, char* buf, int size);
 
-uint8_t fetch8(RL78_CPU* cpu);
-uint16_t fetch16(RL78_CPU* cpu);
-uint8_t* get_sfr(RL78_CPU* cpu, uint8_t code);
+// Every store to guest memory is announced before it happens. Register
+// bank writes through cpu->regs are not.
+void cpu_note_write(RL78_CPU* cpu, uint32_t addr20, uint32_t len);
+#define NOTE_WRITE(cpu, addr20, len) \
+    do { if ((cpu)->replay || (cpu)->write_log) cpu_note_write(cpu, addr20, len); } while (0)
 
-void cpu_init(RL78_CPU* cpu);
+void cpu_sync_bank(RL78_CPU* cpu);
+bool cpu_init(RL78_CPU* cpu);
+void cpu_free(RL78_CPU* cpu);
 void cpu_step(RL78_CPU* cpu);
+void cpu_run(RL78_CPU* cpu, uint64_t until);
 void dump_cpu_state(const RL78_CPU* cpu);
\ No newline at end of file
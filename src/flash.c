@@ -0,0 +1,192 @@
+#include "flash.h"
+#include "cpu.h"
+#include "predecode.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+static bool in_flash(uint32_t addr20)
+{
+    return IS_CODE_FLASH(addr20) || IS_DATA_FLASH(addr20);
+}
+
+static void flash_done(RL78_CPU* cpu, void* ctx)
+{
+    RL78_Flash* flash = ctx;
+    uint32_t addr = flash->addr;
+    uint32_t block = addr & ~(uint32_t)(FLASH_BLOCK_SIZE - 1);
+
+    switch (flash->command)
+    {
+    case FLASH_CMD_WRITE: {
+        // Code flash programs a 4 byte word, data flash a single byte
+        int len = IS_CODE_FLASH(addr) ? 4 : 1;
+        addr &= ~(uint32_t)(len - 1);
+        NOTE_WRITE(cpu, addr, len);
+        for (int i = 0; i < len; i++) {
+            uint8_t data = (uint8_t)(flash->data >> (8 * i));
+            // Programming can only clear bits
+            if ((cpu->memory[addr + i] & data) != data)
+                flash->status |= FLASH_WRER;
+            cpu->memory[addr + i] &= data;
+        }
+        if (cpu->predecode)
+            predecode_invalidate(cpu->predecode, addr, len);
+        break;
+    }
+    case FLASH_CMD_ERASE:
+        NOTE_WRITE(cpu, block, FLASH_BLOCK_SIZE);
+        memset(&cpu->memory[block], FLASH_ERASED, FLASH_BLOCK_SIZE);
+        if (cpu->predecode)
+            predecode_invalidate(cpu->predecode, block, FLASH_BLOCK_SIZE);
+        break;
+    case FLASH_CMD_BLANK:
+        for (int i = 0; i < FLASH_BLOCK_SIZE; i++) {
+            if (cpu->memory[block + i] != FLASH_ERASED) {
+                flash->status |= FLASH_BLER;
+                break;
+            }
+        }
+        break;
+    }
+    flash->busy = false;
+    flash->done = true;
+}
+
+static void flash_start(RL78_Flash* flash, RL78_CPU* cpu, uint8_t command)
+{
+    flash->command = command;
+    flash->addr = (cpu->memory[FLASH_FLAPL] | (cpu->memory[FLASH_FLAPL + 1] << 8)
+        | ((cpu->memory[FLASH_FLAPH] & 0x0F) << 16));
+    flash->data = cpu->memory[FLASH_FLWL] | (cpu->memory[FLASH_FLWL + 1] << 8)
+        | (cpu->memory[FLASH_FLWL + 2] << 16) | ((uint32_t)cpu->memory[FLASH_FLWL + 3] << 24);
+    flash->status = 0;
+    flash->done = false;
+
+    uint32_t cycles;
+    switch (command)
+    {
+    case FLASH_CMD_WRITE:
+        cycles = FLASH_WRITE_CYCLES;
+        break;
+    case FLASH_CMD_ERASE:
+        cycles = FLASH_ERASE_CYCLES;
+        break;
+    case FLASH_CMD_BLANK:
+        cycles = FLASH_BLANK_CYCLES;
+        break;
+    default:
+        flash->status = FLASH_ERER | FLASH_WRER;
+        flash->done = true;
+        return;
+    }
+    if (!in_flash(flash->addr)) {
+        flash->status = command == FLASH_CMD_WRITE ? FLASH_WRER : FLASH_ERER;
+        flash->done = true;
+        return;
+    }
+    flash->busy = true;
+    sched_add(&cpu->sched, cpu->cycles + cycles, flash_done, flash);
+}
+
+void flash_init(RL78_Flash* flash)
+{
+    memset(flash, 0, sizeof(*flash));
+}
+
+bool flash_owns(uint32_t addr20)
+{
+    return addr20 == FLASH_FSSQ || addr20 == FLASH_FSASTL || addr20 == FLASH_FSASTH;
+}
+
+uint8_t flash_read(RL78_Flash* flash, RL78_CPU* cpu, uint32_t addr20)
+{
+    (void)cpu;
+    switch (addr20)
+    {
+    case FLASH_FSASTL:
+        return flash->status;
+    case FLASH_FSASTH:
+        return flash->done ? FLASH_SQEND : 0;
+    default:
+        return 0; // FSSQ reads as zero
+    }
+}
+
+void flash_write(RL78_Flash* flash, RL78_CPU* cpu, uint32_t addr20, uint8_t data)
+{
+    if (addr20 != FLASH_FSSQ)
+        return; // Status registers are read-only
+
+    if (!(data & FLASH_SQST)) {
+        // Writing 0 acknowledges the previous command
+        if (!flash->busy) {
+            flash->done = false;
+            flash->status = 0;
+        }
+    }
+    else if (!flash->busy) {
+        flash_start(flash, cpu, data & 0x07);
+    }
+}
+
+#ifndef _WIN32
+
+// Back [base, base + size) with a shared mapping of path. Pages load on
+// first touch and stores reach the file without an explicit save. A new
+// or short file is extended with erased bytes.
+//
+// The mapping is placed over guest memory, so base and size must be
+// multiples of the host page size. Data flash (0xF1000, 4 KB) only lines
+// up with 4 KB pages and can't be file-backed on 16 KB or 64 KB page hosts.
+bool flash_attach(RL78_CPU* cpu, uint32_t base, uint32_t size, const char* path)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    if (page <= 0 || base % page || size % page) {
+        printf("Flash at 0x%05X (%u bytes) doesn't line up with the host's %ld byte pages\n",
+            base, size, page);
+        return false;
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return false;
+    }
+    if (st.st_size < (off_t)size) {
+        uint8_t erased[FLASH_BLOCK_SIZE];
+        memset(erased, FLASH_ERASED, sizeof(erased));
+        for (off_t off = st.st_size; off < (off_t)size;) {
+            size_t len = (size_t)((off_t)size - off < FLASH_BLOCK_SIZE ? (off_t)size - off : FLASH_BLOCK_SIZE);
+            if (pwrite(fd, erased, len, off) != (ssize_t)len) {
+                close(fd);
+                return false;
+            }
+            off += len;
+        }
+    }
+
+    void* map = mmap(&cpu->memory[base], size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+    close(fd);
+    return map != MAP_FAILED;
+}
+
+#else
+
+bool flash_attach(RL78_CPU* cpu, uint32_t base, uint32_t size, const char* path)
+{
+    (void)cpu; (void)base; (void)size; (void)path;
+    return false;
+}
+
+#endif
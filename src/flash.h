@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct RL78_CPU;
+
+// Flash regions of the memory map. Both are erased in 1 KB blocks and
+// only change through the flash sequencer; ordinary stores are ignored.
+#define CODE_FLASH_BASE  0x00000
+#define CODE_FLASH_SIZE  0x10000 // 64 KB
+#define DATA_FLASH_BASE  0xF1000
+#define DATA_FLASH_SIZE  0x01000 // 4 KB
+#define FLASH_BLOCK_SIZE 0x400
+#define FLASH_ERASED     0xFF
+
+#define IS_CODE_FLASH(addr20) ((addr20) < CODE_FLASH_BASE + CODE_FLASH_SIZE)
+#define IS_DATA_FLASH(addr20) ((addr20) >= DATA_FLASH_BASE && (addr20) < DATA_FLASH_BASE + DATA_FLASH_SIZE)
+
+// Flash sequencer registers in the 2nd SFR area
+#define FLASH_FLAPL  0xF00C0 // Target address bits 15-0
+#define FLASH_FLAPH  0xF00C2 // Target address bits 19-16
+#define FLASH_FSSQ   0xF00C4 // Sequencer command
+#define FLASH_FSASTL 0xF00C6 // Error status
+#define FLASH_FSASTH 0xF00C7 // Sequencer status
+#define FLASH_FLWL   0xF00D0 // Write data, 4 bytes for code flash, 1 byte for data flash
+
+// FSSQ
+#define FLASH_SQST       0x80 // Start the command in bits 2-0
+#define FLASH_CMD_WRITE  0x01
+#define FLASH_CMD_ERASE  0x03 // Erase the block holding the target address
+#define FLASH_CMD_BLANK  0x04 // Blank check the block holding the target address
+
+// FSASTL
+#define FLASH_ERER 0x01 // Erase error
+#define FLASH_WRER 0x02 // Write error, bits would need to go from 0 to 1
+#define FLASH_BLER 0x08 // Blank check error
+
+// FSASTH
+#define FLASH_SQEND 0x40 // Command finished
+
+// Sequencer busy times in CPU clocks, roughly at 32 MHz
+#define FLASH_WRITE_CYCLES 1600   // ~50 us
+#define FLASH_ERASE_CYCLES 160000 // ~5 ms
+#define FLASH_BLANK_CYCLES 3200   // ~100 us
+
+typedef struct {
+    bool busy;
+    bool done; // FSASTH.SQEND
+    uint8_t status; // FSASTL
+    uint8_t command;
+    uint32_t addr;
+    uint32_t data;
+} RL78_Flash;
+
+void flash_init(RL78_Flash* flash);
+bool flash_attach(struct RL78_CPU* cpu, uint32_t base, uint32_t size, const char* path);
+
+bool flash_owns(uint32_t addr20);
+uint8_t flash_read(RL78_Flash* flash, struct RL78_CPU* cpu, uint32_t addr20);
+void flash_write(RL78_Flash* flash, struct RL78_CPU* cpu, uint32_t addr20, uint8_t data);
@@ -10,12 +10,46 @@
 #define LOG(...) ;
 #endif
 
-#define AX cpu->regs.RP[1]
+#define REG_X cpu->regs->R[0]
+#define REG_A cpu->regs->R[1]
+#define AX cpu->regs->RP[0]
+#define BC cpu->regs->RP[1]
+#define DE cpu->regs->RP[2]
+#define HL cpu->regs->RP[3]
+
+// Little endian 16-bit operand at byte n of the instruction
+#define OP16(n) ((uint16_t)(insn->op[n] | (insn->op[(n) + 1] << 8)))
+
+// The stack always lives in the 0xF0000-0xFFFFF window
+#define STACK_ADDR(sp) (0xF0000 | (uint16_t)(sp))
+
+// ALU operations, in the order they appear in the opcode maps (opcode >> 4)
+enum {
+    ALU_ADD,
+    ALU_ADDC,
+    ALU_SUB,
+    ALU_SUBC,
+    ALU_CMP,
+    ALU_AND,
+    ALU_OR,
+    ALU_XOR
+};
+
+#ifdef _DEBUG
+// Operand names for LOG
+static const char* alu_names[] = { "ADD", "ADDC", "SUB", "SUBC", "CMP", "AND", "OR", "XOR" };
+static const char* reg_names[] = { "X", "A", "C", "B", "E", "D", "L", "H" };
+static const char* rp_names[] = { "AX", "BC", "DE", "HL" };
+#endif
 
 static const char* sfr_code_to_name(uint8_t code)
 {
     switch (code)
     {
+    case 0xF8:
+        return "SPL";
+    case 0xF9:
+        return "SPH";
     case 0xFA:
         return "PSW";
     case 0xFC:
@@ -23,33 +57,159 @@ static const char* sfr_code_to_name(uint8_t code)
     case 0xFD:
         return "ES";
     default:
-        break;
+        return "SFR";
     }
 }
 
-static void solve_add_flags(RL78_CPU* cpu, uint8_t dstval, uint8_t srcval, uint16_t result)
+static void solve_add_flags(RL78_CPU* cpu, uint8_t dstval, uint8_t srcval, uint8_t carry, uint16_t result)
 {
     // Set CY (carry out of bit 7)
     cpu->PSW.CY = (result > 0xFF);
 
     // Set AC (carry from bit 3 to bit 4)
-    cpu->PSW.AC = ((dstval & 0x0F) + (srcval & 0x0F)) > 0x0F;
+    cpu->PSW.AC = ((dstval & 0x0F) + (srcval & 0x0F) + carry) > 0x0F;
+
+    // Set Z (zero result)
+    cpu->PSW.Z = ((uint8_t)result == 0);
+}
+
+static void solve_sub_flags(RL78_CPU* cpu, uint8_t dstval, uint8_t srcval, uint8_t borrow, uint16_t result)
+{
+    // Set CY (borrow into bit 7)
+    cpu->PSW.CY = dstval < srcval + borrow;
+
+    // Set AC (borrow from bit 4 to bit 3)
+    cpu->PSW.AC = (dstval & 0x0F) < (srcval & 0x0F) + borrow;
 
     // Set Z (zero result)
     cpu->PSW.Z = ((uint8_t)result == 0);
 }
 
+// 8-bit ALU shared by ADD/ADDC/SUB/SUBC/CMP/AND/OR/XOR.
+// Returns the result, callers skip the write back for CMP.
+static uint8_t alu8(RL78_CPU* cpu, uint8_t op, uint8_t dstval, uint8_t srcval)
+{
+    uint8_t carry = cpu->PSW.CY;
+    uint16_t result = 0;
+
+    switch (op)
+    {
+    case ALU_ADD:
+        carry = 0;
+        // fall through
+    case ALU_ADDC:
+        result = dstval + srcval + carry;
+        solve_add_flags(cpu, dstval, srcval, carry, result);
+        break;
+    case ALU_SUB:
+    case ALU_CMP:
+        carry = 0;
+        // fall through
+    case ALU_SUBC:
+        result = (uint16_t)(dstval - srcval - carry);
+        solve_sub_flags(cpu, dstval, srcval, carry, result);
+        break;
+    case ALU_AND:
+        result = dstval & srcval;
+        cpu->PSW.Z = (result == 0);
+        break;
+    case ALU_OR:
+        result = dstval | srcval;
+        cpu->PSW.Z = (result == 0);
+        break;
+    case ALU_XOR:
+        result = dstval ^ srcval;
+        cpu->PSW.Z = (result == 0);
+        break;
+    }
+    return (uint8_t)result;
+}
+
+// 16-bit ALU for ADDW/SUBW/CMPW. AC reflects the low nibble like the 8-bit ops.
+static uint16_t aluw(RL78_CPU* cpu, uint8_t op, uint16_t dstval, uint16_t srcval)
+{
+    uint32_t result;
+    if (op == ALU_ADD) {
+        result = (uint32_t)dstval + srcval;
+        cpu->PSW.CY = result > 0xFFFF;
+        cpu->PSW.AC = ((dstval & 0x0F) + (srcval & 0x0F)) > 0x0F;
+    }
+    else {
+        result = (uint32_t)dstval - srcval;
+        cpu->PSW.CY = dstval < srcval;
+        cpu->PSW.AC = (dstval & 0x0F) < (srcval & 0x0F);
+    }
+    cpu->PSW.Z = ((uint16_t)result == 0);
+    return (uint16_t)result;
+}
+
+static uint8_t inc8(RL78_CPU* cpu, uint8_t val)
+{
+    uint8_t result = val + 1;
+    cpu->PSW.AC = (val & 0x0F) == 0x0F;
+    cpu->PSW.Z = (result == 0);
+    return result;
+}
+
+static uint8_t dec8(RL78_CPU* cpu, uint8_t val)
+{
+    uint8_t result = val - 1;
+    cpu->PSW.AC = (val & 0x0F) == 0x00;
+    cpu->PSW.Z = (result == 0);
+    return result;
+}
+
+static void push16(RL78_CPU* cpu, uint16_t data)
+{
+    write8_abs(cpu, STACK_ADDR(cpu->SP - 1), HIBYTE(data));
+    write8_abs(cpu, STACK_ADDR(cpu->SP - 2), LOBYTE(data));
+    cpu->SP -= 2;
+}
+
+static uint16_t pop16(RL78_CPU* cpu)
+{
+    uint8_t low = read8_abs(cpu, STACK_ADDR(cpu->SP));
+    uint8_t high = read8_abs(cpu, STACK_ADDR(cpu->SP + 1));
+    cpu->SP += 2;
+    return (high << 8) | low;
+}
+
+// Push a 20-bit return address as CALL does: (SP-2) = PCS, (SP-3) = PCH, (SP-4) = PCL
+static void push_return(RL78_CPU* cpu, uint32_t addr20)
+{
+    write8_abs(cpu, STACK_ADDR(cpu->SP - 2), (addr20 >> 16) & 0x0F);
+    write8_abs(cpu, STACK_ADDR(cpu->SP - 3), (addr20 >> 8) & 0xFF);
+    write8_abs(cpu, STACK_ADDR(cpu->SP - 4), addr20 & 0xFF);
+    cpu->SP -= 4;
+}
+
+static uint32_t pop_return(RL78_CPU* cpu)
+{
+    uint32_t addr20 = read8_abs(cpu, STACK_ADDR(cpu->SP))
+        | (read8_abs(cpu, STACK_ADDR(cpu->SP + 1)) << 8)
+        | ((uint32_t)(read8_abs(cpu, STACK_ADDR(cpu->SP + 2)) & 0x0F) << 16);
+    cpu->SP += 4;
+    return addr20;
+}
+
+// Take a relative branch from the next instruction address (PC has already been advanced)
+static void branch_rel(RL78_CPU* cpu, int16_t disp)
+{
+    SET_PC(cpu, GET_PC(cpu) + disp);
+    cpu->cycles += 2;
+}
+
 // MOVE 8-bit immediate to a general purpose register.
 // size: 2
 // 0x50 ... 0x57, data
 // MOV r, #imm8
-void mov_r_imm8(RL78_CPU* cpu)
+void mov_r_imm8(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    uint16_t instr = fetch16(cpu);
+    uint16_t instr = OP16(0);
     uint8_t opcode = LOBYTE(instr);
     uint8_t operand = HIBYTE(instr);
     uint8_t reg_idx = opcode - 0x50;
-    cpu->regs.R[reg_idx] = operand;
+    cpu->regs->R[reg_idx] = operand;
     LOG("Executed MOV R%d, 0x%02X\n", reg_idx, operand);
 }
 
@@ -57,11 +217,11 @@ void mov_r_imm8(RL78_CPU* cpu)
 // size: 1
 // 0x60, 0x62 ... 67
 // MOV A, r
-void mov_a_r(RL78_CPU* cpu)
+void mov_a_r(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    uint8_t opcode = fetch8(cpu);
+    uint8_t opcode = insn->op[0];
     uint8_t reg_idx = opcode - 0x60;
-    cpu->regs.R[1] = cpu->regs.R[reg_idx];
+    cpu->regs->R[1] = cpu->regs->R[reg_idx];
     LOG("Executed MOV R1, R%d\n", reg_idx);
 }
 
@@ -69,19 +229,18 @@ void mov_a_r(RL78_CPU* cpu)
 // size: 1
 // 0x70, 0x72 ... 77
 // MOV A, r
-void mov_r_a(RL78_CPU* cpu)
+void mov_r_a(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    uint16_t opcode = fetch8(cpu);
+    uint16_t opcode = insn->op[0];
     uint8_t reg_idx = opcode - 0x70;
-    cpu->regs.R[reg_idx] = cpu->regs.R[1];
+    cpu->regs->R[reg_idx] = cpu->regs->R[1];
     LOG("Executed MOV R%d, R1\n", reg_idx);
 }
 
-void mov_addr16_imm8(RL78_CPU* cpu)
+void mov_addr16_imm8(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    INC_PC(cpu, 1);
-    uint16_t addr16 = fetch16(cpu);
-    uint8_t data = fetch8(cpu);
+    uint16_t addr16 = OP16(1);
+    uint8_t data = insn->op[3];
     write8(cpu, addr16, data);
     if (cpu->ext_addressing) {
         LOG("Executed MOV ES:!0x%04X, 0x%02X\n", addr16, data);
@@ -89,10 +248,10 @@ void mov_addr16_imm8(RL78_CPU* cpu)
     else LOG("Executed MOV :!0x%04X, 0x%02X\n", addr16, data);
 }
 
-void mov_r_addr16(RL78_CPU* cpu)
+void mov_r_addr16(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    uint8_t opcode = fetch8(cpu);
-    uint16_t addr16 = fetch16(cpu);
+    uint8_t opcode = insn->op[0];
+    uint16_t addr16 = OP16(1);
     uint8_t reg_idx;
     switch (opcode)
     {
@@ -112,126 +271,122 @@ void mov_r_addr16(RL78_CPU* cpu)
         reg_idx = 0;
         break;
     }
-    cpu->regs.R[reg_idx] = read8(cpu, addr16);
+    cpu->regs->R[reg_idx] = read8(cpu, addr16);
     if (cpu->ext_addressing) {
         LOG("Executed MOV R%d, ES:!0x%04X\n", reg_idx, addr16);
     }
     else LOG("Executed MOV R%d, !0x%04X\n", reg_idx, addr16);
 }
 
-void mov_addr16_a(RL78_CPU* cpu)
+void mov_addr16_a(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    INC_PC(cpu, 1);
-    uint16_t addr = fetch16(cpu);
-    write8(cpu, addr, cpu->regs.R[1]);
+    uint16_t addr = OP16(1);
+    write8(cpu, addr, cpu->regs->R[1]);
     if (cpu->ext_addressing) {
         LOG("Executed MOV ES:!0x%04X, A\n", addr);
     }
     else LOG("Executed MOV !0x%04X, A\n", addr);
 }
 
-void mov_a_indir_rp(RL78_CPU* cpu)
+void mov_a_indir_rp(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    uint8_t opcode = fetch8(cpu);
+    uint8_t opcode = insn->op[0];
     uint8_t reg_idx = opcode == 0x89 ? 2 : 3;
-    uint16_t addrIndir = cpu->regs.RP[reg_idx];
-    cpu->regs.RP[0] = read8_indir(cpu, addrIndir);
+    uint16_t addrIndir = cpu->regs->RP[reg_idx];
+    cpu->regs->R[1] = read8_indir(cpu, addrIndir);
     if (cpu->ext_addressing) {
         LOG("Executed MOV A, ES:[R%d]\n", reg_idx);
     }
     else LOG("Executed MOV A, [R%d]\n", reg_idx);
 }
 
-void mov_a_indir_rp_offset(RL78_CPU* cpu)
+void mov_a_indir_rp_offset(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    uint8_t opcode = fetch8(cpu);
-    uint8_t offset = fetch8(cpu);
+    uint8_t opcode = insn->op[0];
+    uint8_t offset = insn->op[1];
     uint8_t reg_idx = opcode == 0x8A ? 2 : 3;
-    uint16_t addrIndir = cpu->regs.RP[reg_idx] + offset;
-    cpu->regs.RP[0] = read8_indir(cpu, addrIndir);
+    uint16_t addrIndir = cpu->regs->RP[reg_idx] + offset;
+    cpu->regs->R[1] = read8_indir(cpu, addrIndir);
     if (cpu->ext_addressing) {
         LOG("Executed MOV A, ES:[R%d + 0x%02X]\n", reg_idx, offset);
     }
     else LOG("Executed MOV A, [R%d + 0x%02X]\n", reg_idx, offset);
 }
 
-void mov_indir_rp_a(RL78_CPU* cpu)
+void mov_indir_rp_a(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    uint8_t opcode = fetch8(cpu);
+    uint8_t opcode = insn->op[0];
     uint8_t reg_idx = opcode == 0x99 ? 2 : 3;
-    uint16_t addrIndir = cpu->regs.RP[reg_idx];
-    write8_indir(cpu, addrIndir, cpu->regs.R[1]);
+    uint16_t addrIndir = cpu->regs->RP[reg_idx];
+    write8_indir(cpu, addrIndir, cpu->regs->R[1]);
     if (cpu->ext_addressing) {
         LOG("Executed MOV ES:[R%d], A\n", reg_idx);
     }
     else LOG("Executed MOV [R%d], A\n", reg_idx);
 }
 
-void mov_indir_rp_offset_a(RL78_CPU* cpu)
+void mov_indir_rp_offset_a(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    uint8_t opcode = fetch8(cpu);
-    uint8_t offset = fetch8(cpu);
+    uint8_t opcode = insn->op[0];
+    uint8_t offset = insn->op[1];
     uint8_t reg_idx = opcode == 0x9A ? 2 : 3;
-    uint16_t addrIndir = cpu->regs.RP[reg_idx] + offset;
-    write8_indir(cpu, addrIndir, cpu->regs.R[1]);
+    uint16_t addrIndir = cpu->regs->RP[reg_idx] + offset;
+    write8_indir(cpu, addrIndir, cpu->regs->R[1]);
     if (cpu->ext_addressing) {
         LOG("Executed MOV ES:[R%d + 0x%02X], A\n", reg_idx, offset);
     }
     else LOG("Executed MOV [R%d + 0x%02X], A\n", reg_idx, offset);
 }
 
-void mov_indir_rp_offset_imm8(RL78_CPU* cpu)
+void mov_indir_rp_offset_imm8(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    uint8_t opcode = fetch8(cpu);
+    uint8_t opcode = insn->op[0];
     uint8_t reg_idx = opcode == 0xCA ? 2 : 3;
-    uint8_t offset = fetch8(cpu);
-    uint8_t data = fetch8(cpu);
-    write8_indir(cpu, cpu->regs.RP[reg_idx] + offset, data);
+    uint8_t offset = insn->op[1];
+    uint8_t data = insn->op[2];
+    write8_indir(cpu, cpu->regs->RP[reg_idx] + offset, data);
     if (cpu->ext_addressing) {
         LOG("Executed MOV ES:[R%d + 0x%02X], 0x%02X\n", reg_idx, offset, data);
     }
     else LOG("Executed MOV [R%d + 0x%02X], 0x%02X\n", reg_idx, offset, data);
 }
 
-void mov_a_indir_hl_plus_r(RL78_CPU* cpu)
+void mov_a_indir_hl_plus_r(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    INC_PC(cpu, 1);
-    uint8_t oper = fetch8(cpu);
+    uint8_t oper = insn->op[1];
     uint8_t reg_idx = oper == 0xC9 ? 3 : 2;
-    uint16_t addrIndir = cpu->regs.RP[3] + cpu->regs.R[reg_idx];
-    cpu->regs.RP[1] = read8_indir(cpu, addrIndir);
+    uint16_t addrIndir = cpu->regs->RP[3] + cpu->regs->R[reg_idx];
+    cpu->regs->R[1] = read8_indir(cpu, addrIndir);
     if (cpu->ext_addressing) {
         LOG("Executed MOV A, ES:[HL + R%d]\n", reg_idx);
     }
     else LOG("Executed MOV A, [HL + R%d]\n", reg_idx);
 }
 
-void mov_indir_hl_plus_r_a(RL78_CPU* cpu)
+void mov_indir_hl_plus_r_a(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    INC_PC(cpu, 1);
-    uint8_t oper = fetch8(cpu);
+    uint8_t oper = insn->op[1];
     uint8_t reg_idx = oper == 0xD9 ? 3 : 2;
-    uint16_t addrIndir = cpu->regs.RP[3] + cpu->regs.R[reg_idx];
-    cpu->regs.R[1] = read8_indir(cpu, addrIndir);
+    uint16_t addrIndir = cpu->regs->RP[3] + cpu->regs->R[reg_idx];
+    write8_indir(cpu, addrIndir, cpu->regs->R[1]);
     if (cpu->ext_addressing) {
         LOG("Executed MOV ES:[HL + R%d], A\n", reg_idx);
     }
     else LOG("Executed MOV [HL + R%d], A\n", reg_idx);
 }
 
-void mov_saddr_imm8(RL78_CPU* cpu)
+void mov_saddr_imm8(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    INC_PC(cpu, 1);
-    uint8_t saddr = fetch8(cpu);
-    uint8_t data = fetch8(cpu);
+    uint8_t saddr = insn->op[1];
+    uint8_t data = insn->op[2];
     write8_saddr(cpu, saddr, data);
     LOG("Executed MOV 0x%02X, 0x%02X\n", saddr, data);
 }
 
-void mov_r_saddr(RL78_CPU* cpu)
+void mov_r_saddr(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    uint8_t opcode = fetch8(cpu);
-    uint8_t saddr = fetch8(cpu);
+    uint8_t opcode = insn->op[0];
+    uint8_t saddr = insn->op[1];
     uint8_t reg_idx;
     switch (opcode)
     {
@@ -251,25 +406,24 @@ void mov_r_saddr(RL78_CPU* cpu)
         reg_idx = 0;
         break;
     }
-    cpu->regs.R[reg_idx] = read8_saddr(cpu, saddr);
+    cpu->regs->R[reg_idx] = read8_saddr(cpu, saddr);
     LOG("Executed MOV R%d, 0x%02X\n", reg_idx, saddr);
 }
 
-void mov_saddr_a(RL78_CPU* cpu)
+void mov_saddr_a(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    INC_PC(cpu, 1);
-    uint8_t saddr = fetch8(cpu);
-    write8_saddr(cpu, saddr, cpu->regs.R[1]);
+    uint8_t saddr = insn->op[1];
+    write8_saddr(cpu, saddr, cpu->regs->R[1]);
     LOG("Executed MOV 0x%02X, A\n", saddr);
 }
 
-void mov_based_r_imm8(RL78_CPU* cpu)
+void mov_based_r_imm8(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    uint8_t opcode = fetch8(cpu);
+    uint8_t opcode = insn->op[0];
     uint8_t reg_idx = opcode == 0x19 ? 3 : 2;
-    uint16_t addr = fetch16(cpu);
-    uint16_t indirAddr = addr + cpu->regs.R[reg_idx];
-    uint8_t data = fetch8(cpu);
+    uint16_t addr = OP16(1);
+    uint16_t indirAddr = addr + cpu->regs->R[reg_idx];
+    uint8_t data = insn->op[3];
     write8_indir(cpu, indirAddr, data);
     if (cpu->ext_addressing) {
         LOG("Executed MOV ES:0x%04X[R%d], 0x%02X\n", addr, reg_idx, data);
@@ -277,12 +431,11 @@ void mov_based_r_imm8(RL78_CPU* cpu)
     else LOG("Executed MOV 0x%04X[R%d], 0x%02X\n", addr, reg_idx, data);
 }
 
-void mov_based_bc_imm8(RL78_CPU* cpu)
+void mov_based_bc_imm8(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    INC_PC(cpu, 1);
-    uint16_t addr = fetch16(cpu);
-    uint16_t indirAddr = addr + cpu->regs.RP[1]; // TODO: check overflow
-    uint8_t data = fetch8(cpu);
+    uint16_t addr = OP16(1);
+    uint16_t indirAddr = addr + BC;
+    uint8_t data = insn->op[3];
     write8_indir(cpu, indirAddr, data);
     if (cpu->ext_addressing) {
         LOG("Executed MOV ES:0x%04X[BC], 0x%02X\n", addr, data);
@@ -290,45 +443,181 @@ void mov_based_bc_imm8(RL78_CPU* cpu)
     else LOG("Executed MOV 0x%04X[BC], 0x%02X\n", addr, data);
 }
 
-void mov_sfr_imm8(RL78_CPU* cpu)
+// MOVE A to/from word[B] and word[C]
+// size: 3
+// 0x18 / 0x28, addr16 (store), 0x09 / 0x29, addr16 (load)
+void mov_based_r_a(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t opcode = insn->op[0];
+    uint8_t reg_idx = opcode == 0x18 ? 3 : 2;
+    uint16_t addr = OP16(1);
+    write8_indir(cpu, addr + cpu->regs->R[reg_idx], REG_A);
+    LOG("Executed MOV 0x%04X[%s], A\n", addr, reg_names[reg_idx]);
+}
+
+void mov_a_based_r(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    INC_PC(cpu, 1);
-    uint8_t code = fetch8(cpu);
-    uint8_t* sfr = get_sfr(cpu, code);
-    uint8_t data = fetch8(cpu);
-    *sfr = data;
+    uint8_t opcode = insn->op[0];
+    uint8_t reg_idx = opcode == 0x09 ? 3 : 2;
+    uint16_t addr = OP16(1);
+    REG_A = read8_indir(cpu, addr + cpu->regs->R[reg_idx]);
+    LOG("Executed MOV A, 0x%04X[%s]\n", addr, reg_names[reg_idx]);
+}
+
+void mov_based_bc_a(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint16_t addr = OP16(1);
+    write8_indir(cpu, addr + BC, REG_A);
+    LOG("Executed MOV 0x%04X[BC], A\n", addr);
+}
+
+void mov_a_based_bc(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint16_t addr = OP16(1);
+    REG_A = read8_indir(cpu, addr + BC);
+    LOG("Executed MOV A, 0x%04X[BC]\n", addr);
+}
+
+// Stack relative moves, never use ES
+// 0x88 MOV A, [SP+byte] / 0x98 MOV [SP+byte], A / 0xC8 MOV [SP+byte], #byte
+void mov_a_indir_sp_offset(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t offset = insn->op[1];
+    REG_A = read8_abs(cpu, STACK_ADDR(cpu->SP + offset));
+    LOG("Executed MOV A, [SP + 0x%02X]\n", offset);
+}
+
+void mov_indir_sp_offset_a(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t offset = insn->op[1];
+    write8_abs(cpu, STACK_ADDR(cpu->SP + offset), REG_A);
+    LOG("Executed MOV [SP + 0x%02X], A\n", offset);
+}
+
+void mov_indir_sp_offset_imm8(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t offset = insn->op[1];
+    uint8_t data = insn->op[2];
+    write8_abs(cpu, STACK_ADDR(cpu->SP + offset), data);
+    LOG("Executed MOV [SP + 0x%02X], 0x%02X\n", offset, data);
+}
+
+// Extended multiply / divide, encoded as MOV sfr(0xFB), #code
+static void muldiv_ext(RL78_CPU* cpu, uint8_t code)
+{
+    switch (code)
+    {
+    case 0x01: { // MULHU: BCAX = AX * BC
+        uint32_t result = (uint32_t)AX * BC;
+        AX = (uint16_t)result;
+        BC = (uint16_t)(result >> 16);
+        cpu->cycles += 1;
+        LOG("Executed MULHU\n");
+        break;
+    }
+    case 0x02: { // MULH: signed BCAX = AX * BC
+        int32_t result = (int32_t)(int16_t)AX * (int16_t)BC;
+        AX = (uint16_t)result;
+        BC = (uint16_t)((uint32_t)result >> 16);
+        cpu->cycles += 1;
+        LOG("Executed MULH\n");
+        break;
+    }
+    case 0x03: { // DIVHU: AX = AX / DE, DE = AX % DE
+        uint16_t dividend = AX;
+        if (DE == 0) {
+            AX = 0xFFFF;
+            DE = dividend;
+        }
+        else {
+            AX = dividend / DE;
+            DE = dividend % DE;
+        }
+        cpu->cycles += 8;
+        LOG("Executed DIVHU\n");
+        break;
+    }
+    case 0x0B: { // DIVWU: BCAX = BCAX / HLDE, HLDE = BCAX % HLDE
+        uint32_t dividend = ((uint32_t)BC << 16) | AX;
+        uint32_t divisor = ((uint32_t)HL << 16) | DE;
+        uint32_t quotient = divisor ? dividend / divisor : 0xFFFFFFFF;
+        uint32_t remainder = divisor ? dividend % divisor : dividend;
+        AX = (uint16_t)quotient;
+        BC = (uint16_t)(quotient >> 16);
+        DE = (uint16_t)remainder;
+        HL = (uint16_t)(remainder >> 16);
+        cpu->cycles += 16;
+        LOG("Executed DIVWU\n");
+        break;
+    }
+    case 0x05: { // MACHU: MACR += AX * BC
+        uint32_t macr = read16_sfr(cpu, 0xF0) | ((uint32_t)read16_sfr(cpu, 0xF2) << 16);
+        uint32_t product = (uint32_t)AX * BC;
+        uint32_t result = macr + product;
+        cpu->PSW.CY = result < macr;
+        cpu->PSW.AC = 0;
+        write16_sfr(cpu, 0xF0, (uint16_t)result);
+        write16_sfr(cpu, 0xF2, (uint16_t)(result >> 16));
+        cpu->cycles += 2;
+        LOG("Executed MACHU\n");
+        break;
+    }
+    case 0x06: { // MACH: signed MACR += AX * BC
+        int32_t macr = (int32_t)(read16_sfr(cpu, 0xF0) | ((uint32_t)read16_sfr(cpu, 0xF2) << 16));
+        int32_t product = (int32_t)(int16_t)AX * (int16_t)BC;
+        int64_t wide = (int64_t)macr + product;
+        int32_t result = (int32_t)(uint32_t)wide;
+        cpu->PSW.CY = wide != result;
+        cpu->PSW.AC = result < 0;
+        write16_sfr(cpu, 0xF0, (uint16_t)result);
+        write16_sfr(cpu, 0xF2, (uint16_t)((uint32_t)result >> 16));
+        cpu->cycles += 2;
+        LOG("Executed MACH\n");
+        break;
+    }
+    default:
+        write8_sfr(cpu, 0xFB, code);
+        break;
+    }
+}
+
+void mov_sfr_imm8(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t code = insn->op[1];
+    uint8_t data = insn->op[2];
+    if (code == 0xFB) {
+        muldiv_ext(cpu, data);
+        return;
+    }
+    write8_sfr(cpu, code, data);
     LOG("Executed MOV %s, 0x%02X\n", sfr_code_to_name(code), data);
 }
 
-void mov_es_imm8(RL78_CPU* cpu)
+void mov_es_imm8(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    INC_PC(cpu, 1);
-    uint8_t data = fetch8(cpu);
-    cpu->ES = data;
+    uint8_t data = insn->op[1];
+    cpu->ES = data & 0x0F;
     LOG("Executed MOV ES, 0x%02X\n", data);
 }
 
-void mov_a_sfr(RL78_CPU* cpu)
+void mov_a_sfr(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    INC_PC(cpu, 1);
-    uint8_t code = fetch8(cpu);
-    cpu->regs.R[1] = *get_sfr(cpu, code);
+    uint8_t code = insn->op[1];
+    cpu->regs->R[1] = read8_sfr(cpu, code);
     LOG("Executed MOV A, %s\n", sfr_code_to_name(code));
 }
 
-void mov_sfr_a(RL78_CPU* cpu)
+void mov_sfr_a(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    INC_PC(cpu, 1);
-    uint8_t code = fetch8(cpu);
-    *get_sfr(cpu, code) = cpu->regs.R[1];
+    uint8_t code = insn->op[1];
+    write8_sfr(cpu, code, cpu->regs->R[1]);
     LOG("Executed MOV %s, A\n", sfr_code_to_name(code));
 }
 
-void mov_es_saddr(RL78_CPU* cpu)
+void mov_es_saddr(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    INC_PC(cpu, 2);
-    uint8_t saddr = fetch8(cpu);
-    cpu->ES = read8_saddr(cpu, saddr);
+    uint8_t saddr = insn->op[2];
+    cpu->ES = read8_saddr(cpu, saddr) & 0x0F;
     LOG("Executed MOV ES, 0x%02X\n", saddr);
 }
 
@@ -336,156 +625,1204 @@ void mov_es_saddr(RL78_CPU* cpu)
 // size: 1
 // 0x80 ... 0x87
 // INC r
-void inc_r(RL78_CPU* cpu)
+void inc_r(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    uint8_t opcode = fetch8(cpu);
-    cpu->regs.R[opcode - 0x80]++;
+    uint8_t opcode = insn->op[0];
+    cpu->regs->R[opcode - 0x80] = inc8(cpu, cpu->regs->R[opcode - 0x80]);
     LOG("Executed INC R%d\n", opcode - 0x80);
 }
 
+// Decrement a value in a general purpose register by 1
+// size: 1
+// 0x90 ... 0x97
+// DEC r
+void dec_r(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t opcode = insn->op[0];
+    cpu->regs->R[opcode - 0x90] = dec8(cpu, cpu->regs->R[opcode - 0x90]);
+    LOG("Executed DEC R%d\n", opcode - 0x90);
+}
+
+void inc_saddr(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t saddr = insn->op[1];
+    write8_saddr(cpu, saddr, inc8(cpu, read8_saddr(cpu, saddr)));
+    LOG("Executed INC 0x%02X\n", saddr);
+}
+
+void dec_saddr(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t saddr = insn->op[1];
+    write8_saddr(cpu, saddr, dec8(cpu, read8_saddr(cpu, saddr)));
+    LOG("Executed DEC 0x%02X\n", saddr);
+}
+
+void inc_addr16(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint16_t addr16 = OP16(1);
+    write8(cpu, addr16, inc8(cpu, read8(cpu, addr16)));
+    LOG("Executed INC !0x%04X\n", addr16);
+}
+
+void dec_addr16(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint16_t addr16 = OP16(1);
+    write8(cpu, addr16, dec8(cpu, read8(cpu, addr16)));
+    LOG("Executed DEC !0x%04X\n", addr16);
+}
+
+void inc_indir_hl_offset(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t offset = insn->op[2];
+    uint16_t addr = HL + offset;
+    write8_indir(cpu, addr, inc8(cpu, read8_indir(cpu, addr)));
+    LOG("Executed INC [HL + 0x%02X]\n", offset);
+}
+
+void dec_indir_hl_offset(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t offset = insn->op[2];
+    uint16_t addr = HL + offset;
+    write8_indir(cpu, addr, dec8(cpu, read8_indir(cpu, addr)));
+    LOG("Executed DEC [HL + 0x%02X]\n", offset);
+}
+
+// INCW / DECW never affect flags
+// 0xA1 ... 0xA7 (odd) INCW rp, 0xB1 ... 0xB7 (odd) DECW rp
+void incw_rp(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t rp_idx = (insn->op[0] - 0xA1) / 2;
+    cpu->regs->RP[rp_idx]++;
+    LOG("Executed INCW %s\n", rp_names[rp_idx]);
+}
+
+void decw_rp(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t rp_idx = (insn->op[0] - 0xB1) / 2;
+    cpu->regs->RP[rp_idx]--;
+    LOG("Executed DECW %s\n", rp_names[rp_idx]);
+}
+
+void incw_saddrp(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t saddr = insn->op[1];
+    write16_saddr(cpu, saddr, read16_saddr(cpu, saddr) + 1);
+    LOG("Executed INCW 0x%02X\n", saddr);
+}
+
+void decw_saddrp(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t saddr = insn->op[1];
+    write16_saddr(cpu, saddr, read16_saddr(cpu, saddr) - 1);
+    LOG("Executed DECW 0x%02X\n", saddr);
+}
+
+void incw_addr16(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint16_t addr16 = OP16(1);
+    write16(cpu, addr16, read16(cpu, addr16) + 1);
+    LOG("Executed INCW !0x%04X\n", addr16);
+}
+
+void decw_addr16(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint16_t addr16 = OP16(1);
+    write16(cpu, addr16, read16(cpu, addr16) - 1);
+    LOG("Executed DECW !0x%04X\n", addr16);
+}
+
+void incw_indir_hl_offset(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t offset = insn->op[2];
+    uint16_t addr = HL + offset;
+    write16(cpu, addr, read16(cpu, addr) + 1);
+    LOG("Executed INCW [HL + 0x%02X]\n", offset);
+}
+
+void decw_indir_hl_offset(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t offset = insn->op[2];
+    uint16_t addr = HL + offset;
+    write16(cpu, addr, read16(cpu, addr) - 1);
+    LOG("Executed DECW [HL + 0x%02X]\n", offset);
+}
+
 // Unconditional branch to 16-bit address in AX (RP0) register
 // size: 2
 // 0x61, 0xCB
 // BR AX
-void br_ax(RL78_CPU* cpu)
+void br_ax(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    SET_PC(cpu, cpu->regs.RP[0]);
+    (void)insn;
+    SET_PC(cpu, ((uint32_t)cpu->CS << 16) | cpu->regs->RP[0]);
     LOG("Executed BR AX\n");
 }
 
+// BR $addr20, 8-bit displacement from the next instruction
+// size: 2
+// 0xEF, disp
+void br_rel8(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    int8_t disp = (int8_t)insn->op[1];
+    SET_PC(cpu, GET_PC(cpu) + disp);
+    LOG("Executed BR $%d\n", disp);
+}
+
+// BR $!addr20, 16-bit displacement from the next instruction
+// size: 3
+// 0xEE, disp16
+void br_rel16(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    int16_t disp = (int16_t)OP16(1);
+    SET_PC(cpu, GET_PC(cpu) + disp);
+    LOG("Executed BR $!%d\n", disp);
+}
+
+// BR !addr16, target in 0x00000-0x0FFFF
+// size: 3
+// 0xED, addr16
+void br_addr16(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint16_t addr16 = OP16(1);
+    SET_PC(cpu, addr16);
+    LOG("Executed BR !0x%04X\n", addr16);
+}
+
+// BR !!addr20
+// size: 4
+// 0xEC, addr20
+void br_addr20(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint32_t addr20 = OP16(1);
+    addr20 |= (uint32_t)(insn->op[3] & 0x0F) << 16;
+    SET_PC(cpu, addr20);
+    LOG("Executed BR !!0x%05X\n", addr20);
+}
+
+// BC / BZ / BNC / BNZ $addr20
+// size: 2
+// 0xDC ... 0xDF, disp
+void bcond_rel8(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t opcode = insn->op[0];
+    int8_t disp = (int8_t)insn->op[1];
+    bool taken;
+    switch (opcode)
+    {
+    case 0xDC: taken = cpu->PSW.CY; break;
+    case 0xDD: taken = cpu->PSW.Z; break;
+    case 0xDE: taken = !cpu->PSW.CY; break;
+    default:   taken = !cpu->PSW.Z; break;
+    }
+    if (taken)
+        branch_rel(cpu, disp);
+    LOG("Executed Bcc $%d (%s)\n", disp, taken ? "taken" : "not taken");
+}
+
+// BH / BNH $addr20, H = !(Z | CY)
+// size: 3
+// 0x61, 0xC3 / 0xD3, disp
+void bcond_h_rel8(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t opcode = insn->op[1];
+    int8_t disp = (int8_t)insn->op[2];
+    bool higher = !(cpu->PSW.Z || cpu->PSW.CY);
+    bool taken = opcode == 0xC3 ? higher : !higher;
+    if (taken)
+        branch_rel(cpu, disp);
+    LOG("Executed %s $%d\n", opcode == 0xC3 ? "BH" : "BNH", disp);
+}
+
+// SKC / SKNC / SKZ / SKNZ / SKH / SKNH, skip the next instruction if condition holds
+// size: 2
+// 0x61, 0xC8 / 0xD8 / 0xE8 / 0xF8 / 0xE3 / 0xF3
+void skip_cond(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t opcode = insn->op[1];
+    bool higher = !(cpu->PSW.Z || cpu->PSW.CY);
+    bool skip;
+    switch (opcode)
+    {
+    case 0xC8: skip = cpu->PSW.CY; break;
+    case 0xD8: skip = !cpu->PSW.CY; break;
+    case 0xE8: skip = cpu->PSW.Z; break;
+    case 0xF8: skip = !cpu->PSW.Z; break;
+    case 0xE3: skip = higher; break;
+    default:   skip = !higher; break;
+    }
+    if (skip)
+        INC_PC(cpu, cpu_insn_size(cpu, GET_PC(cpu)));
+    LOG("Executed SKcc (%s)\n", skip ? "skipped" : "not skipped");
+}
+
+void call_addr16(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint16_t addr16 = OP16(1);
+    push_return(cpu, GET_PC(cpu));
+    SET_PC(cpu, addr16);
+    LOG("Executed CALL !0x%04X\n", addr16);
+}
+
+void call_addr20(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint32_t addr20 = OP16(1);
+    addr20 |= (uint32_t)(insn->op[3] & 0x0F) << 16;
+    push_return(cpu, GET_PC(cpu));
+    SET_PC(cpu, addr20);
+    LOG("Executed CALL !!0x%05X\n", addr20);
+}
+
+void call_rel16(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    int16_t disp = (int16_t)OP16(1);
+    push_return(cpu, GET_PC(cpu));
+    SET_PC(cpu, GET_PC(cpu) + disp);
+    LOG("Executed CALL $!%d\n", disp);
+}
+
+// CALL rp, target is CS:rp
+// size: 2
+// 0x61, 0xCA / 0xDA / 0xEA / 0xFA
+void call_rp(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t rp_idx = (insn->op[1] - 0xCA) >> 4;
+    push_return(cpu, GET_PC(cpu));
+    SET_PC(cpu, ((uint32_t)cpu->CS << 16) | cpu->regs->RP[rp_idx]);
+    LOG("Executed CALL %s\n", rp_names[rp_idx]);
+}
+
+// CALLT [0x0080 ... 0x00BE], call through the CALLT table
+// size: 2
+// 0x61, 0x84 ... 0xF7 (bits 2-3 = 01)
+void callt_inst(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t opcode = insn->op[1];
+    uint16_t entry = 0x80 + ((opcode & 0x03) << 4) + (((opcode >> 4) - 8) << 1);
+    push_return(cpu, GET_PC(cpu));
+    SET_PC(cpu, cpu->memory[entry] | (cpu->memory[entry + 1] << 8));
+    LOG("Executed CALLT [0x%04X]\n", entry);
+}
+
+// Software interrupt through the vector at 0x0007E
+void brk_inst(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    (void)insn;
+    write8_abs(cpu, STACK_ADDR(cpu->SP - 1), cpu->PSW.asByte);
+    push_return(cpu, GET_PC(cpu));
+    cpu->PSW.IE = 0;
+    SET_PC(cpu, cpu->memory[0x7E] | (cpu->memory[0x7F] << 8));
+    LOG("Executed BRK\n");
+}
+
+void ret_inst(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    (void)insn;
+    SET_PC(cpu, pop_return(cpu));
+    LOG("Executed RET\n");
+}
+
+// RETI / RETB also restore PSW from (SP+3)
+static void ret_psw(RL78_CPU* cpu)
+{
+    uint8_t psw = read8_abs(cpu, STACK_ADDR(cpu->SP + 3));
+    SET_PC(cpu, pop_return(cpu));
+    write8_sfr(cpu, 0xFA, psw);
+}
+
+void reti_inst(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    (void)insn;
+    ret_psw(cpu);
+    LOG("Executed RETI\n");
+}
+
+void retb_inst(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    (void)insn;
+    ret_psw(cpu);
+    LOG("Executed RETB\n");
+}
+
+// HALT / STOP. Without interrupt sources the CPU just stops stepping.
+void halt_inst(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    (void)insn;
+    cpu->halted = true;
+    LOG("Executed HALT\n");
+}
+
+void stop_inst(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    (void)insn;
+    cpu->halted = true;
+    LOG("Executed STOP\n");
+}
+
+// PUSH / POP rp
+// size: 1
+// 0xC1 ... 0xC7 (odd) PUSH, 0xC0 ... 0xC6 (even) POP
+void push_rp(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t rp_idx = (insn->op[0] - 0xC1) / 2;
+    push16(cpu, cpu->regs->RP[rp_idx]);
+    LOG("Executed PUSH %s\n", rp_names[rp_idx]);
+}
+
+void pop_rp(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t rp_idx = (insn->op[0] - 0xC0) / 2;
+    cpu->regs->RP[rp_idx] = pop16(cpu);
+    LOG("Executed POP %s\n", rp_names[rp_idx]);
+}
+
+// PUSH PSW stores PSW at (SP-1) and 0x00 at (SP-2)
+void push_psw(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    (void)insn;
+    push16(cpu, cpu->PSW.asByte << 8);
+    LOG("Executed PUSH PSW\n");
+}
+
+void pop_psw(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    (void)insn;
+    write8_sfr(cpu, 0xFA, HIBYTE(pop16(cpu)));
+    LOG("Executed POP PSW\n");
+}
+
+// Select register bank n (sets PSW.RBS0/RBS1)
+// size: 2
+// 0x61, 0xCF / 0xDF / 0xEF / 0xFF
+// SEL RBn
+void sel_rb(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t bank = (insn->op[1] >> 4) - 0x0C;
+    cpu->PSW.RBS0 = bank & 1;
+    cpu->PSW.RBS1 = bank >> 1;
+    cpu_sync_bank(cpu);
+    LOG("Executed SEL RB%d\n", bank);
+}
+
 // No operation, increment PC by 1.
 // size 1
 // 0x00
 // NOP
-void nop_inst(RL78_CPU* cpu)
+void nop_inst(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    INC_PC(cpu, 1);
+    (void)cpu; (void)insn;
     LOG("Executed NOP\n");
 }
 
 // Exchange values between R1 and other R
 // size: 1 OR 2
 // 0x08 or 0x61, 0x8A...0x8F
-void xch_a_r(RL78_CPU* cpu)
+void xch_a_r(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    uint8_t opcode = fetch8(cpu);
+    uint8_t opcode = insn->op[0];
     if (opcode == 0x08)
     {
-        uint16_t val = cpu->regs.RP[0];
+        uint16_t val = cpu->regs->RP[0];
         // swap bytes in RP
-        cpu->regs.RP[0] = (val >> 8) | (val << 8);
+        cpu->regs->RP[0] = (val >> 8) | (val << 8);
         LOG("Executed XCH A, X");
     }
     else
     {
-        uint8_t operand = fetch8(cpu);
-        uint8_t reg_idx = operand - 0x8A;
-        uint8_t temp = cpu->regs.R[1];
-        cpu->regs.R[1] = cpu->regs.R[reg_idx];
-        cpu->regs.R[reg_idx] = temp;
+        uint8_t operand = insn->op[1];
+        uint8_t reg_idx = operand - 0x88;
+        uint8_t temp = cpu->regs->R[1];
+        cpu->regs->R[1] = cpu->regs->R[reg_idx];
+        cpu->regs->R[reg_idx] = temp;
         LOG("Executed XCH A, R%d\n", reg_idx);
     }
 }
 
-void oneb_r(RL78_CPU* cpu)
+void xch_a_saddr(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t saddr = insn->op[2];
+    uint8_t temp = REG_A;
+    REG_A = read8_saddr(cpu, saddr);
+    write8_saddr(cpu, saddr, temp);
+    LOG("Executed XCH A, 0x%02X\n", saddr);
+}
+
+void xch_a_sfr(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t code = insn->op[2];
+    uint8_t temp = REG_A;
+    REG_A = read8_sfr(cpu, code);
+    write8_sfr(cpu, code, temp);
+    LOG("Executed XCH A, %s\n", sfr_code_to_name(code));
+}
+
+void xch_a_addr16(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint16_t addr16 = OP16(2);
+    uint8_t temp = REG_A;
+    REG_A = read8(cpu, addr16);
+    write8(cpu, addr16, temp);
+    LOG("Executed XCH A, !0x%04X\n", addr16);
+}
+
+// XCH A, [HL] / [DE]
+// 0x61, 0xAC / 0xAE
+void xch_a_indir_rp(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t rp_idx = insn->op[1] == 0xAE ? 2 : 3;
+    uint16_t addr = cpu->regs->RP[rp_idx];
+    uint8_t temp = REG_A;
+    REG_A = read8_indir(cpu, addr);
+    write8_indir(cpu, addr, temp);
+    LOG("Executed XCH A, [%s]\n", rp_names[rp_idx]);
+}
+
+// XCH A, [HL+byte] / [DE+byte]
+// 0x61, 0xAD / 0xAF, offset
+void xch_a_indir_rp_offset(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t rp_idx = insn->op[1] == 0xAF ? 2 : 3;
+    uint8_t offset = insn->op[2];
+    uint16_t addr = cpu->regs->RP[rp_idx] + offset;
+    uint8_t temp = REG_A;
+    REG_A = read8_indir(cpu, addr);
+    write8_indir(cpu, addr, temp);
+    LOG("Executed XCH A, [%s + 0x%02X]\n", rp_names[rp_idx], offset);
+}
+
+// XCH A, [HL+B] / [HL+C]
+// 0x61, 0xB9 / 0xA9
+void xch_a_indir_hl_r(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t reg_idx = insn->op[1] == 0xB9 ? 3 : 2;
+    uint16_t addr = HL + cpu->regs->R[reg_idx];
+    uint8_t temp = REG_A;
+    REG_A = read8_indir(cpu, addr);
+    write8_indir(cpu, addr, temp);
+    LOG("Executed XCH A, [HL + %s]\n", reg_names[reg_idx]);
+}
+
+void oneb_r(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    uint8_t reg_idx = fetch8(cpu) - 0xE0;
-    cpu->regs.R[reg_idx] = 0x01;
+    uint8_t reg_idx = insn->op[0] - 0xE0;
+    cpu->regs->R[reg_idx] = 0x01;
     LOG("Executed ONEB R%d\n", reg_idx);
 }
 
-void clrb_r(RL78_CPU* cpu)
+void oneb_saddr(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    uint8_t reg_idx = fetch8(cpu) - 0xF0;
-    cpu->regs.R[reg_idx] = 0x00;
+    uint8_t saddr = insn->op[1];
+    write8_saddr(cpu, saddr, 0x01);
+    LOG("Executed ONEB 0x%02X\n", saddr);
+}
+
+void oneb_addr16(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint16_t addr16 = OP16(1);
+    write8(cpu, addr16, 0x01);
+    LOG("Executed ONEB !0x%04X\n", addr16);
+}
+
+void clrb_r(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t reg_idx = insn->op[0] - 0xF0;
+    cpu->regs->R[reg_idx] = 0x00;
     LOG("Executed CLRB R%d\n", reg_idx);
 }
 
-void movw_rp_imm16(RL78_CPU* cpu)
+void clrb_saddr(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t saddr = insn->op[1];
+    write8_saddr(cpu, saddr, 0x00);
+    LOG("Executed CLRB 0x%02X\n", saddr);
+}
+
+void clrb_addr16(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint16_t addr16 = OP16(1);
+    write8(cpu, addr16, 0x00);
+    LOG("Executed CLRB !0x%04X\n", addr16);
+}
+
+// CMP0 compares against zero, AC and CY are cleared
+// 0xD0 ... 0xD3 CMP0 r, 0xD4 CMP0 saddr, 0xD5 CMP0 !addr16
+static void cmp0(RL78_CPU* cpu, uint8_t val)
+{
+    cpu->PSW.Z = (val == 0);
+    cpu->PSW.AC = 0;
+    cpu->PSW.CY = 0;
+}
+
+void cmp0_r(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t reg_idx = insn->op[0] - 0xD0;
+    cmp0(cpu, cpu->regs->R[reg_idx]);
+    LOG("Executed CMP0 %s\n", reg_names[reg_idx]);
+}
+
+void cmp0_saddr(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t saddr = insn->op[1];
+    cmp0(cpu, read8_saddr(cpu, saddr));
+    LOG("Executed CMP0 0x%02X\n", saddr);
+}
+
+void cmp0_addr16(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    uint8_t rp_idx = (fetch8(cpu) - 0x30)/2;
-    uint16_t data = fetch16(cpu);
-    cpu->regs.RP[rp_idx] = data;
+    uint16_t addr16 = OP16(1);
+    cmp0(cpu, read8(cpu, addr16));
+    LOG("Executed CMP0 !0x%04X\n", addr16);
+}
+
+// MOVS [HL+byte], X: Z if X == 0, CY if A == 0 or X == 0
+void movs_indir_hl_offset_x(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t offset = insn->op[2];
+    write8_indir(cpu, HL + offset, REG_X);
+    cpu->PSW.Z = (REG_X == 0);
+    cpu->PSW.CY = (REG_A == 0) || (REG_X == 0);
+    LOG("Executed MOVS [HL + 0x%02X], X\n", offset);
+}
+
+// CMPS X, [HL+byte]: like CMP, but CY is set if A == 0, X == 0 or they differ
+void cmps_x_indir_hl_offset(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t offset = insn->op[2];
+    uint8_t val = read8_indir(cpu, HL + offset);
+    alu8(cpu, ALU_CMP, REG_X, val);
+    cpu->PSW.CY = (REG_A == 0) || (REG_X == 0) || (REG_X != val);
+    LOG("Executed CMPS X, [HL + 0x%02X]\n", offset);
+}
+
+// MULU X: AX = A * X
+void mulu_x(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    (void)insn;
+    AX = (uint16_t)REG_A * REG_X;
+    LOG("Executed MULU X\n");
+}
+
+void movw_rp_imm16(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t rp_idx = (insn->op[0] - 0x30)/2;
+    uint16_t data = OP16(1);
+    cpu->regs->RP[rp_idx] = data;
     LOG("Executed MOVW RP%d, 0x%04X", rp_idx, data);
 }
 
-void movw_ax_rp(RL78_CPU* cpu)
+void movw_ax_rp(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    uint8_t rp_idx = (fetch8(cpu) - 0x13) / 2;
-    cpu->regs.RP[0] = cpu->regs.RP[rp_idx];
+    uint8_t rp_idx = 1 + (insn->op[0] - 0x13) / 2;
+    cpu->regs->RP[0] = cpu->regs->RP[rp_idx];
     LOG("Executed MOVW AX, RP%d\n", rp_idx);
 }
 
-void movw_rp_ax(RL78_CPU* cpu)
+void movw_rp_ax(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    uint8_t rp_idx =1+ (fetch8(cpu) - 0x12) / 2;
-    cpu->regs.RP[rp_idx] = cpu->regs.RP[0];
+    uint8_t rp_idx =1+ (insn->op[0] - 0x12) / 2;
+    cpu->regs->RP[rp_idx] = cpu->regs->RP[0];
     LOG("Executed MOVW RP%d, AX\n", rp_idx);
 }
 
-void xchw_ax_rp(RL78_CPU* cpu)
+void xchw_ax_rp(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    uint8_t rp_idx = (fetch8(cpu) - 0x33) / 2;
-    uint16_t temp = cpu->regs.RP[1];
-    AX = cpu->regs.RP[rp_idx];
-    cpu->regs.RP[rp_idx] = temp;
+    uint8_t rp_idx = 1 + (insn->op[0] - 0x33) / 2;
+    uint16_t temp = AX;
+    AX = cpu->regs->RP[rp_idx];
+    cpu->regs->RP[rp_idx] = temp;
     LOG("Executed XCHW AX, RP%d, AX\n", rp_idx);
 }
 
-void onew_rp(RL78_CPU* cpu)
+void onew_rp(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    uint8_t rp_idx = fetch8(cpu) - 0xE6;
-    cpu->regs.RP[rp_idx] = 0x0001;
+    uint8_t rp_idx = insn->op[0] - 0xE6;
+    cpu->regs->RP[rp_idx] = 0x0001;
     LOG("Executed ONEW RP%d\n", rp_idx);
 }
 
-void clrw_rp(RL78_CPU* cpu)
+void clrw_rp(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    uint8_t rp_idx = fetch8(cpu) - 0xF6;
-    cpu->regs.RP[rp_idx] = 0x0000;
+    uint8_t rp_idx = insn->op[0] - 0xF6;
+    cpu->regs->RP[rp_idx] = 0x0000;
     LOG("Executed CLRW RP%d\n", rp_idx);
 }
 
-void add_a_imm8(RL78_CPU* cpu)
+// MOVW AX, [DE] / [HL] and back
+// 0xA9 / 0xAB load, 0xB9 / 0xBB store
+void movw_ax_indir_rp(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t rp_idx = insn->op[0] == 0xA9 ? 2 : 3;
+    AX = read16(cpu, cpu->regs->RP[rp_idx]);
+    LOG("Executed MOVW AX, [%s]\n", rp_names[rp_idx]);
+}
+
+void movw_indir_rp_ax(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t rp_idx = insn->op[0] == 0xB9 ? 2 : 3;
+    write16(cpu, cpu->regs->RP[rp_idx], AX);
+    LOG("Executed MOVW [%s], AX\n", rp_names[rp_idx]);
+}
+
+// MOVW AX, [DE+byte] / [HL+byte] and back
+// 0xAA / 0xAC load, 0xBA / 0xBC store
+void movw_ax_indir_rp_offset(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t rp_idx = insn->op[0] == 0xAA ? 2 : 3;
+    uint8_t offset = insn->op[1];
+    AX = read16(cpu, cpu->regs->RP[rp_idx] + offset);
+    LOG("Executed MOVW AX, [%s + 0x%02X]\n", rp_names[rp_idx], offset);
+}
+
+void movw_indir_rp_offset_ax(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t rp_idx = insn->op[0] == 0xBA ? 2 : 3;
+    uint8_t offset = insn->op[1];
+    write16(cpu, cpu->regs->RP[rp_idx] + offset, AX);
+    LOG("Executed MOVW [%s + 0x%02X], AX\n", rp_names[rp_idx], offset);
+}
+
+void movw_ax_indir_sp_offset(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t offset = insn->op[1];
+    uint16_t addr = (cpu->SP + offset) & 0xFFFE;
+    AX = read8_abs(cpu, STACK_ADDR(addr)) | (read8_abs(cpu, STACK_ADDR(addr + 1)) << 8);
+    LOG("Executed MOVW AX, [SP + 0x%02X]\n", offset);
+}
+
+void movw_indir_sp_offset_ax(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t offset = insn->op[1];
+    uint16_t addr = (cpu->SP + offset) & 0xFFFE;
+    write8_abs(cpu, STACK_ADDR(addr), LOBYTE(AX));
+    write8_abs(cpu, STACK_ADDR(addr + 1), HIBYTE(AX));
+    LOG("Executed MOVW [SP + 0x%02X], AX\n", offset);
+}
+
+void movw_ax_saddrp(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t saddr = insn->op[1];
+    AX = read16_saddr(cpu, saddr);
+    LOG("Executed MOVW AX, 0x%02X\n", saddr);
+}
+
+void movw_saddrp_ax(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t saddr = insn->op[1];
+    write16_saddr(cpu, saddr, AX);
+    LOG("Executed MOVW 0x%02X, AX\n", saddr);
+}
+
+void movw_saddrp_imm16(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t saddr = insn->op[1];
+    uint16_t data = OP16(2);
+    write16_saddr(cpu, saddr, data);
+    LOG("Executed MOVW 0x%02X, 0x%04X\n", saddr, data);
+}
+
+void movw_ax_sfrp(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t code = insn->op[1];
+    AX = read16_sfr(cpu, code);
+    LOG("Executed MOVW AX, %s\n", sfr_code_to_name(code));
+}
+
+void movw_sfrp_ax(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t code = insn->op[1];
+    write16_sfr(cpu, code, AX);
+    LOG("Executed MOVW %s, AX\n", sfr_code_to_name(code));
+}
+
+void movw_sfrp_imm16(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t code = insn->op[1];
+    uint16_t data = OP16(2);
+    write16_sfr(cpu, code, data);
+    LOG("Executed MOVW %s, 0x%04X\n", sfr_code_to_name(code), data);
+}
+
+void movw_ax_addr16(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint16_t addr16 = OP16(1);
+    AX = read16(cpu, addr16);
+    LOG("Executed MOVW AX, !0x%04X\n", addr16);
+}
+
+void movw_addr16_ax(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint16_t addr16 = OP16(1);
+    write16(cpu, addr16, AX);
+    LOG("Executed MOVW !0x%04X, AX\n", addr16);
+}
+
+// MOVW BC / DE / HL, saddrp
+// 0xDA / 0xEA / 0xFA
+void movw_rp_saddrp(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t rp_idx = ((insn->op[0] - 0xDA) >> 4) + 1;
+    uint8_t saddr = insn->op[1];
+    cpu->regs->RP[rp_idx] = read16_saddr(cpu, saddr);
+    LOG("Executed MOVW %s, 0x%02X\n", rp_names[rp_idx], saddr);
+}
+
+// MOVW BC / DE / HL, !addr16
+// 0xDB / 0xEB / 0xFB
+void movw_rp_addr16(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t rp_idx = ((insn->op[0] - 0xDB) >> 4) + 1;
+    uint16_t addr16 = OP16(1);
+    cpu->regs->RP[rp_idx] = read16(cpu, addr16);
+    LOG("Executed MOVW %s, !0x%04X\n", rp_names[rp_idx], addr16);
+}
+
+// MOVW word[B] / word[C] / word[BC], AX and back
+// 0x58 / 0x68 / 0x78 store, 0x59 / 0x69 / 0x79 load
+void movw_based_r_ax(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t reg_idx = insn->op[0] == 0x58 ? 3 : 2;
+    uint16_t addr = OP16(1);
+    write16(cpu, addr + cpu->regs->R[reg_idx], AX);
+    LOG("Executed MOVW 0x%04X[%s], AX\n", addr, reg_names[reg_idx]);
+}
+
+void movw_ax_based_r(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t reg_idx = insn->op[0] == 0x59 ? 3 : 2;
+    uint16_t addr = OP16(1);
+    AX = read16(cpu, addr + cpu->regs->R[reg_idx]);
+    LOG("Executed MOVW AX, 0x%04X[%s]\n", addr, reg_names[reg_idx]);
+}
+
+void movw_based_bc_ax(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint16_t addr = OP16(1);
+    write16(cpu, addr + BC, AX);
+    LOG("Executed MOVW 0x%04X[BC], AX\n", addr);
+}
+
+void movw_ax_based_bc(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    INC_PC(cpu, 1);
-    uint8_t val = fetch8(cpu);
-    uint16_t result = val + cpu->regs.R[1];
-    solve_add_flags(cpu, cpu->regs.R[1], val, result);
-    cpu->regs.R[1] = (uint8_t)result;
-    LOG("Executed ADD A, 0x%02X\n", val);
+    uint16_t addr = OP16(1);
+    AX = read16(cpu, addr + BC);
+    LOG("Executed MOVW AX, 0x%04X[BC]\n", addr);
 }
 
-void add_a_r(RL78_CPU* cpu)
+// 8-bit ALU, operation selected by the high nibble of the opcode
+// 0x0A ... 0x7A: op saddr, #byte
+void alu_saddr_imm8(RL78_CPU* cpu, const RL78_Insn* insn)
 {
-    INC_PC(cpu, 1);
-    uint8_t operand = fetch8(cpu);
-    uint8_t val;
-    if (operand == 0x08)
+    uint8_t op = insn->op[0] >> 4;
+    uint8_t saddr = insn->op[1];
+    uint8_t val = insn->op[2];
+    uint8_t result = alu8(cpu, op, read8_saddr(cpu, saddr), val);
+    if (op != ALU_CMP)
+        write8_saddr(cpu, saddr, result);
+    LOG("Executed %s 0x%02X, 0x%02X\n", alu_names[op], saddr, val);
+}
+
+// 0x0B ... 0x7B: op A, saddr
+void alu_a_saddr(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t op = insn->op[0] >> 4;
+    uint8_t saddr = insn->op[1];
+    uint8_t result = alu8(cpu, op, REG_A, read8_saddr(cpu, saddr));
+    if (op != ALU_CMP)
+        REG_A = result;
+    LOG("Executed %s A, 0x%02X\n", alu_names[op], saddr);
+}
+
+// 0x0C ... 0x7C: op A, #byte
+void alu_a_imm8(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t op = insn->op[0] >> 4;
+    uint8_t val = insn->op[1];
+    uint8_t result = alu8(cpu, op, REG_A, val);
+    if (op != ALU_CMP)
+        REG_A = result;
+    LOG("Executed %s A, 0x%02X\n", alu_names[op], val);
+}
+
+// 0x0D ... 0x7D: op A, [HL]
+void alu_a_indir_hl(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t op = insn->op[0] >> 4;
+    uint8_t result = alu8(cpu, op, REG_A, read8_indir(cpu, HL));
+    if (op != ALU_CMP)
+        REG_A = result;
+    LOG("Executed %s A, [HL]\n", alu_names[op]);
+}
+
+// 0x0E ... 0x7E: op A, [HL+byte]
+void alu_a_indir_hl_offset(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t op = insn->op[0] >> 4;
+    uint8_t offset = insn->op[1];
+    uint8_t result = alu8(cpu, op, REG_A, read8_indir(cpu, HL + offset));
+    if (op != ALU_CMP)
+        REG_A = result;
+    LOG("Executed %s A, [HL + 0x%02X]\n", alu_names[op], offset);
+}
+
+// 0x0F ... 0x7F: op A, !addr16
+void alu_a_addr16(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t op = insn->op[0] >> 4;
+    uint16_t addr16 = OP16(1);
+    uint8_t result = alu8(cpu, op, REG_A, read8(cpu, addr16));
+    if (op != ALU_CMP)
+        REG_A = result;
+    LOG("Executed %s A, !0x%04X\n", alu_names[op], addr16);
+}
+
+// CMP !addr16, #byte
+// size: 4
+// 0x40, addr16, data
+void cmp_addr16_imm8(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint16_t addr16 = OP16(1);
+    uint8_t val = insn->op[3];
+    alu8(cpu, ALU_CMP, read8(cpu, addr16), val);
+    LOG("Executed CMP !0x%04X, 0x%02X\n", addr16, val);
+}
+
+// 0x61, 0x00 ... 0x77: op r, A
+void alu_r_a(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t operand = insn->op[1];
+    uint8_t op = operand >> 4;
+    uint8_t reg_idx = operand & 0x07;
+    uint8_t result = alu8(cpu, op, cpu->regs->R[reg_idx], REG_A);
+    if (op != ALU_CMP)
+        cpu->regs->R[reg_idx] = result;
+    LOG("Executed %s %s, A\n", alu_names[op], reg_names[reg_idx]);
+}
+
+// 0x61, 0x08 ... 0x7F: op A, r
+void alu_a_r(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t operand = insn->op[1];
+    uint8_t op = operand >> 4;
+    uint8_t reg_idx = operand & 0x07;
+    uint8_t result = alu8(cpu, op, REG_A, cpu->regs->R[reg_idx]);
+    if (op != ALU_CMP)
+        REG_A = result;
+    LOG("Executed %s A, %s\n", alu_names[op], reg_names[reg_idx]);
+}
+
+// 0x61, 0x80 ... 0xF2: op A, [HL+B] (low nibble 0) / [HL+C] (low nibble 2)
+void alu_a_indir_hl_r(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t operand = insn->op[1];
+    uint8_t op = (operand >> 4) - 8;
+    uint8_t reg_idx = (operand & 0x0F) == 0 ? 3 : 2;
+    uint8_t result = alu8(cpu, op, REG_A, read8_indir(cpu, HL + cpu->regs->R[reg_idx]));
+    if (op != ALU_CMP)
+        REG_A = result;
+    LOG("Executed %s A, [HL + %s]\n", alu_names[op], reg_names[reg_idx]);
+}
+
+// ADDW / SUBW / CMPW, operation selected by the high nibble (0x0_, 0x2_, 0x4_)
+// 0x01 / 0x03 / 0x05 / 0x07 ...: op AX, rp
+void aluw_ax_rp(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t opcode = insn->op[0];
+    uint8_t op = opcode >> 4;
+    uint8_t rp_idx = (opcode & 0x0F) / 2;
+    uint16_t result = aluw(cpu, op, AX, cpu->regs->RP[rp_idx]);
+    if (op != ALU_CMP)
+        AX = result;
+    LOG("Executed %sW AX, %s\n", alu_names[op], rp_names[rp_idx]);
+}
+
+void aluw_ax_imm16(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t op = insn->op[0] >> 4;
+    uint16_t val = OP16(1);
+    uint16_t result = aluw(cpu, op, AX, val);
+    if (op != ALU_CMP)
+        AX = result;
+    LOG("Executed %sW AX, 0x%04X\n", alu_names[op], val);
+}
+
+void aluw_ax_addr16(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t op = insn->op[0] >> 4;
+    uint16_t addr16 = OP16(1);
+    uint16_t result = aluw(cpu, op, AX, read16(cpu, addr16));
+    if (op != ALU_CMP)
+        AX = result;
+    LOG("Executed %sW AX, !0x%04X\n", alu_names[op], addr16);
+}
+
+void aluw_ax_saddrp(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t op = insn->op[0] >> 4;
+    uint8_t saddr = insn->op[1];
+    uint16_t result = aluw(cpu, op, AX, read16_saddr(cpu, saddr));
+    if (op != ALU_CMP)
+        AX = result;
+    LOG("Executed %sW AX, 0x%02X\n", alu_names[op], saddr);
+}
+
+// 0x61, 0x09 / 0x29 / 0x49: op AX, [HL+byte]
+void aluw_ax_indir_hl_offset(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t op = insn->op[1] >> 4;
+    uint8_t offset = insn->op[2];
+    uint16_t result = aluw(cpu, op, AX, read16(cpu, HL + offset));
+    if (op != ALU_CMP)
+        AX = result;
+    LOG("Executed %sW AX, [HL + 0x%02X]\n", alu_names[op], offset);
+}
+
+// ADDW SP, #byte / SUBW SP, #byte, no flags affected
+// 0x10 / 0x20, data
+void aluw_sp_imm8(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t opcode = insn->op[0];
+    uint8_t val = insn->op[1];
+    if (opcode == 0x10)
+        cpu->SP += val;
+    else
+        cpu->SP -= val;
+    LOG("Executed %s SP, 0x%02X\n", opcode == 0x10 ? "ADDW" : "SUBW", val);
+}
+
+// ROR / ROL / RORC / ROLC A, 1
+// 0x61, 0xDB / 0xEB / 0xFB / 0xDC
+void rot_a(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t opcode = insn->op[1];
+    uint8_t val = REG_A;
+    uint8_t carry = cpu->PSW.CY;
+    switch (opcode)
     {
-        val = cpu->regs.R[0];
+    case 0xDB:
+        cpu->PSW.CY = val & 0x01;
+        REG_A = (val >> 1) | (val << 7);
+        break;
+    case 0xEB:
+        cpu->PSW.CY = val >> 7;
+        REG_A = (val << 1) | (val >> 7);
+        break;
+    case 0xFB:
+        cpu->PSW.CY = val & 0x01;
+        REG_A = (val >> 1) | (carry << 7);
+        break;
+    default:
+        cpu->PSW.CY = val >> 7;
+        REG_A = (val << 1) | carry;
+        break;
     }
-    else
+    LOG("Executed rotate A (0x%02X)\n", opcode);
+}
+
+// ROLWC AX / BC, 1: rotate left through carry
+// 0x61, 0xEE / 0xFE
+void rolwc_rp(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t rp_idx = insn->op[1] == 0xEE ? 0 : 1;
+    uint16_t val = cpu->regs->RP[rp_idx];
+    uint8_t carry = cpu->PSW.CY;
+    cpu->PSW.CY = val >> 15;
+    cpu->regs->RP[rp_idx] = (val << 1) | carry;
+    LOG("Executed ROLWC %s, 1\n", rp_names[rp_idx]);
+}
+
+// SHL C / B / A, SHR A, SAR A by cnt (bits 4-6), CY = last bit shifted out
+// 0x31, 0x_7 ... 0x_B
+void shift_r(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t operand = insn->op[1];
+    uint8_t cnt = operand >> 4;
+    uint8_t kind = operand & 0x0F;
+    uint8_t reg_idx = kind == 0x07 ? 2 : kind == 0x08 ? 3 : 1;
+    uint8_t val = cpu->regs->R[reg_idx];
+    if (cnt == 0)
+        return;
+
+    switch (kind)
     {
-        val = cpu->regs.R[operand - 0x0A];
+    case 0x0A:
+        cpu->PSW.CY = (val >> (cnt - 1)) & 1;
+        val >>= cnt;
+        break;
+    case 0x0B:
+        cpu->PSW.CY = (val >> (cnt - 1)) & 1;
+        val = (uint8_t)((int8_t)val >> cnt);
+        break;
+    default:
+        cpu->PSW.CY = (val >> (8 - cnt)) & 1;
+        val <<= cnt;
+        break;
     }
+    cpu->regs->R[reg_idx] = val;
+    LOG("Executed shift %s, %d\n", reg_names[reg_idx], cnt);
+}
 
-    uint16_t result = val + cpu->regs.R[1];
-    solve_add_flags(cpu, cpu->regs.R[1], val, result);
-    cpu->regs.R[1] = (uint8_t)result;
+// SHLW BC / AX, SHRW AX, SARW AX by cnt (bits 4-7), CY = last bit shifted out
+// 0x31, 0x_C ... 0x_F
+void shiftw_rp(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t operand = insn->op[1];
+    uint8_t cnt = operand >> 4;
+    uint8_t kind = operand & 0x0F;
+    uint8_t rp_idx = kind == 0x0C ? 1 : 0;
+    uint16_t val = cpu->regs->RP[rp_idx];
+    if (cnt == 0)
+        return;
 
-    LOG("Executed ADD A, R%d\n", operand - 0x0A);
+    switch (kind)
+    {
+    case 0x0E:
+        cpu->PSW.CY = (val >> (cnt - 1)) & 1;
+        val >>= cnt;
+        break;
+    case 0x0F:
+        cpu->PSW.CY = (val >> (cnt - 1)) & 1;
+        val = (uint16_t)((int16_t)val >> cnt);
+        break;
+    default:
+        cpu->PSW.CY = (val >> (16 - cnt)) & 1;
+        val <<= cnt;
+        break;
+    }
+    cpu->regs->RP[rp_idx] = val;
+    LOG("Executed shiftw %s, %d\n", rp_names[rp_idx], cnt);
 }
 
-void add_r_a(RL78_CPU* cpu)
+// Bit addressed operands of the 3rd and 4th maps
+enum {
+    BIT_LOC_SADDR,
+    BIT_LOC_SFR,
+    BIT_LOC_HL,
+    BIT_LOC_A,
+    BIT_LOC_ADDR16
+};
+
+static uint8_t bit_loc_read(RL78_CPU* cpu, uint8_t loc, uint16_t addr)
 {
-    INC_PC(cpu, 1);
-    uint8_t operand = fetch8(cpu);
-    uint8_t val = cpu->regs.R[operand - 0x00];
+    switch (loc)
+    {
+    case BIT_LOC_SADDR: return read8_saddr(cpu, (uint8_t)addr);
+    case BIT_LOC_SFR:   return read8_sfr(cpu, (uint8_t)addr);
+    case BIT_LOC_HL:    return read8_indir(cpu, HL);
+    case BIT_LOC_A:     return REG_A;
+    default:            return read8(cpu, addr);
+    }
+}
 
-    uint16_t result = val + cpu->regs.R[1];
-    solve_add_flags(cpu, cpu->regs.R[1], val, result);
-    cpu->regs.R[1] = (uint8_t)result;
+static void bit_loc_write(RL78_CPU* cpu, uint8_t loc, uint16_t addr, uint8_t data)
+{
+    switch (loc)
+    {
+    case BIT_LOC_SADDR: write8_saddr(cpu, (uint8_t)addr, data); break;
+    case BIT_LOC_SFR:   write8_sfr(cpu, (uint8_t)addr, data); break;
+    case BIT_LOC_HL:    write8_indir(cpu, HL, data); break;
+    case BIT_LOC_A:     REG_A = data; break;
+    default:            write8(cpu, addr, data); break;
+    }
+}
 
-    LOG("Executed ADD R%d, A\n", operand - 0x00);
+// SET1 / CLR1 / NOT1 / MOV1 / AND1 / OR1 / XOR1
+// 0x71, op: bit 7 selects [HL] / A / CY over saddr / sfr / !addr16,
+// bits 4-6 are the bit number, the low nibble the operation.
+void bit_manip(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t operand = insn->op[1];
+    uint8_t bit = (operand >> 4) & 0x07;
+    uint8_t kind = operand & 0x0F;
+    uint8_t loc;
+    uint16_t addr = 0;
+
+    switch (operand)
+    {
+    case 0x80:
+        cpu->PSW.CY = 1;
+        LOG("Executed SET1 CY\n");
+        return;
+    case 0x88:
+        cpu->PSW.CY = 0;
+        LOG("Executed CLR1 CY\n");
+        return;
+    case 0xC0:
+        cpu->PSW.CY = !cpu->PSW.CY;
+        LOG("Executed NOT1 CY\n");
+        return;
+    }
+
+    if (operand & 0x80) {
+        loc = kind < 8 ? BIT_LOC_HL : BIT_LOC_A;
+    }
+    else if (kind == 0x00 || kind == 0x08) {
+        loc = BIT_LOC_ADDR16;
+        addr = OP16(2);
+    }
+    else {
+        loc = kind < 8 ? BIT_LOC_SADDR : BIT_LOC_SFR;
+        addr = insn->op[2];
+    }
+
+    uint8_t val = bit_loc_read(cpu, loc, addr);
+    uint8_t mask = 1 << bit;
+    bool set = (val & mask) != 0;
+
+    switch (loc == BIT_LOC_ADDR16 ? (kind ? 3 : 2) : kind & 0x07)
+    {
+    case 1: // MOV1 x.n, CY
+        bit_loc_write(cpu, loc, addr, cpu->PSW.CY ? val | mask : val & ~mask);
+        break;
+    case 2: // SET1 x.n
+        bit_loc_write(cpu, loc, addr, val | mask);
+        break;
+    case 3: // CLR1 x.n
+        bit_loc_write(cpu, loc, addr, val & ~mask);
+        break;
+    case 4: // MOV1 CY, x.n
+        cpu->PSW.CY = set;
+        break;
+    case 5: // AND1 CY, x.n
+        cpu->PSW.CY = cpu->PSW.CY && set;
+        break;
+    case 6: // OR1 CY, x.n
+        cpu->PSW.CY = cpu->PSW.CY || set;
+        break;
+    case 7: // XOR1 CY, x.n
+        cpu->PSW.CY = cpu->PSW.CY ^ set;
+        break;
+    }
+    LOG("Executed bit op 0x%02X on bit %d\n", operand, bit);
+}
+
+// BTCLR / BT / BF x.n, $addr20
+// 0x31, op: low nibble 0/1 BTCLR, 2/3 BT, 4/5 BF; odd forms use A (or [HL]
+// with bit 7 set), even forms take a saddr (or sfr with bit 7 set) operand.
+void bit_test_branch(RL78_CPU* cpu, const RL78_Insn* insn)
+{
+    uint8_t operand = insn->op[1];
+    uint8_t bit = (operand >> 4) & 0x07;
+    uint8_t kind = operand & 0x0F;
+    bool high = (operand & 0x80) != 0;
+    uint8_t loc;
+    uint16_t addr = 0;
+
+    if (kind & 1) {
+        loc = high ? BIT_LOC_HL : BIT_LOC_A;
+    }
+    else {
+        loc = high ? BIT_LOC_SFR : BIT_LOC_SADDR;
+        addr = insn->op[2];
+    }
+    int8_t disp = (int8_t)insn->op[(kind & 1) ? 2 : 3];
+
+    uint8_t val = bit_loc_read(cpu, loc, addr);
+    bool set = (val & (1 << bit)) != 0;
+    bool taken = kind >= 4 ? !set : set;
+
+    if (taken) {
+        if (kind < 2)
+            bit_loc_write(cpu, loc, addr, val & ~(1 << bit));
+        branch_rel(cpu, disp);
+    }
+    LOG("Executed bit test 0x%02X on bit %d (%s)\n", operand, bit, taken ? "taken" : "not taken");
 }
@@ -1,48 +1,35 @@
 #pragma once
 
-void mov_r_imm8(RL78_CPU* cpu);
-void mov_a_r(RL78_CPU* cpu);
-void mov_r_a(RL78_CPU* cpu);
-void mov_addr16_imm8(RL78_CPU* cpu);
-void mov_r_addr16(RL78_CPU* cpu);
-void mov_addr16_a(RL78_CPU* cpu);
-void mov_a_indir_rp(RL78_CPU* cpu);
-void mov_a_indir_rp_offset(RL78_CPU* cpu);
-void mov_indir_rp_a(RL78_CPU* cpu);
-void mov_indir_rp_offset_a(RL78_CPU* cpu);
-void mov_indir_rp_offset_imm8(RL78_CPU* cpu);
-void mov_a_indir_hl_plus_r(RL78_CPU* cpu);
-void mov_indir_hl_plus_r_a(RL78_CPU* cpu);
-void mov_saddr_imm8(RL78_CPU* cpu);
-void mov_r_saddr(RL78_CPU* cpu);
-void mov_saddr_a(RL78_CPU* cpu);
-void mov_based_r_imm8(RL78_CPU* cpu);
-void mov_based_bc_imm8(RL78_CPU* cpu);
-void mov_sfr_imm8(RL78_CPU* cpu);
-void mov_es_imm8(RL78_CPU* cpu);
-void mov_a_sfr(RL78_CPU* cpu);
-void mov_sfr_a(RL78_CPU* cpu);
-void mov_es_saddr(RL78_CPU* cpu);
-
-void inc_r(RL78_CPU* cpu);
-void br_ax(RL78_CPU* cpu);
-
-void nop_inst(RL78_CPU* cpu);
-
-void xch_a_r(RL78_CPU* cpu);
-
-void oneb_r(RL78_CPU* cpu);
-
-void clrb_r(RL78_CPU* cpu);
-
-void movw_rp_imm16(RL78_CPU* cpu);
-void movw_ax_rp(RL78_CPU* cpu);
-void movw_rp_ax(RL78_CPU* cpu);
-
-void xchw_ax_rp(RL78_CPU* cpu);
-void onew_rp(RL78_CPU* cpu);
-void clrw_rp(RL78_CPU* cpu);
-
-void add_a_imm8(RL78_CPU* cpu);
-void add_a_r(RL78_CPU* cpu);
-void add_r_a(RL78_CPU* cpu);
\ No newline at end of file
+// Opcode maps. The 2nd, 3rd and 4th maps are selected by prefix bytes
+// 0x61, 0x71 and 0x31.
+enum {
+    MAP_1ST,
+    MAP_2ND,
+    MAP_3RD,
+    MAP_4TH,
+    MAP_COUNT
+};
+
+// Instruction bytes handed to a handler, loaded with a single wide read.
+// op[0] is the opcode (or map prefix), never the ES: prefix. PC already
+// points at the next instruction when the handler runs.
+typedef struct {
+    uint8_t op[8];
+} RL78_Insn;
+
+typedef struct {
+    void (*exec)(RL78_CPU* cpu, const RL78_Insn* insn);
+    uint8_t size; // Length in bytes, including map prefix
+    uint8_t cycles; // Base execution cycles
+    const char* mnemonic;
+} RL78_Opcode;
+
+const RL78_Opcode* decode_bytes(uint8_t opcode_1st, uint8_t opcode_2nd);
+uint16_t decode_index(const RL78_Opcode* op);
+const RL78_Opcode* decode_entry(uint16_t index);
+uint64_t decode_spec_hash(void);
+
+// Handler prototypes, one per distinct handler in opcodes.def
+#define OPCODE(map, code, mask, handler, size, cycles, mnemonic) void handler(RL78_CPU* cpu, const RL78_Insn* insn);
+#include "opcodes.def"
+#undef OPCODE
@@ -1,36 +1,343 @@
-﻿#include <stdio.h>
+﻿#include <signal.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "conformance.h"
 #include "cpu.h"
+#include "pace.h"
+#include "predecode.h"
+#include "replay.h"
+#include "uart.h"
 
-static int load_test_program(RL78_CPU* cpu)
+// Cycles executed between host I/O polls and pacing checks in --run mode
+#define RUN_QUANTUM 10000
+
+static volatile sig_atomic_t interrupted = 0;
+static volatile sig_atomic_t stats_requested = 0;
+
+static void on_interrupt(int sig)
+{
+    (void)sig;
+    interrupted = 1;
+}
+
+static void on_stats_request(int sig)
+{
+    (void)sig;
+    stats_requested = 1;
+}
+
+// Accepts a plain number of Hz or a k / M / G suffix, e.g. 32M
+static uint64_t parse_hz(const char* text)
 {
-    FILE* file = fopen("./example_program/test.bin", "rb");
+    char* end;
+    double value = strtod(text, &end);
+    if (*end == 'k' || *end == 'K')
+        value *= 1e3;
+    else if (*end == 'm' || *end == 'M')
+        value *= 1e6;
+    else if (*end == 'g' || *end == 'G')
+        value *= 1e9;
+    return value > 0 ? (uint64_t)value : 0;
+}
+
+// Programming a file-backed code flash erases it first, so nothing the file
+// held before survives past the end of the image. The image is read in
+// full before that, so a bad one leaves the file as it was.
+static int load_program(RL78_CPU* cpu, const char* path, bool erase)
+{
+    FILE* file = fopen(path, "rb");
     if (file == NULL)
     {
+        printf("Couldn't load %s\n", path);
         return 0;
     }
-    fread(cpu->memory, sizeof(uint8_t), ROM_SIZE, file);
+    uint8_t* image = malloc(CODE_FLASH_SIZE + 1);
+    size_t len = image ? fread(image, sizeof(uint8_t), CODE_FLASH_SIZE + 1, file) : 0;
+    bool ok = image && !ferror(file);
     fclose(file);
+    if (!ok)
+    {
+        printf("Couldn't load %s\n", path);
+        free(image);
+        return 0;
+    }
+    if (len > CODE_FLASH_SIZE)
+    {
+        printf("%s is larger than the %d byte code flash\n", path, CODE_FLASH_SIZE);
+        free(image);
+        return 0;
+    }
+
+    if (erase)
+        memset(&cpu->memory[CODE_FLASH_BASE], FLASH_ERASED, CODE_FLASH_SIZE);
+    memcpy(&cpu->memory[CODE_FLASH_BASE], image, len);
+    free(image);
     return 1;
 }
 
-int main(void)
+static void step(RL78_CPU* cpu)
+{
+    char line[64];
+    disassemble(cpu, GET_PC(cpu), line, sizeof(line));
+    printf("0x%05X: %s\n", GET_PC(cpu), line);
+    cpu_step(cpu);
+    sched_run_due(&cpu->sched, cpu);
+}
+
+// Single-step command line. Returns false to quit.
+static bool debug_command(RL78_CPU* cpu)
+{
+    char line[64];
+    if (fgets(line, sizeof(line), stdin) == NULL)
+        return false;
+
+    unsigned long long value;
+    switch (line[0]) {
+    case '\n':
+    case 's':
+        step(cpu);
+        break;
+    case 'q':
+        return false;
+    case 'b':
+        if (cpu->replay == NULL || !replay_step_back(cpu->replay, cpu))
+            printf("No earlier state\n");
+        break;
+    case 'g':
+        if (cpu->replay == NULL || sscanf(line + 1, "%llu", &value) != 1
+            || !replay_seek(cpu->replay, cpu, value))
+            printf("Can't go to that cycle\n");
+        break;
+    case 'w':
+        if (cpu->replay == NULL || sscanf(line + 1, "%llx", &value) != 1)
+            printf("Usage: w ADDR\n");
+        else if (!replay_find_write(cpu->replay, cpu, (uint32_t)value & 0xFFFFF))
+            printf("No write to 0x%05llX in the history\n", value & 0xFFFFF);
+        break;
+    default:
+        printf("s: step, b: step back, g CYCLE: go to cycle, w ADDR: back to last write, q: quit\n");
+        return true;
+    }
+    dump_cpu_state(cpu);
+    return true;
+}
+
+static void usage(const char* name)
+{
+    printf("usage: %s [options] [image.bin]\n", name);
+    printf("  --run               run freely instead of single-stepping\n");
+    printf("  --clock HZ          with --run, pace the guest to wall-clock time at\n");
+    printf("                      HZ (e.g. 32M) instead of running flat out\n");
+    printf("  --stats FORMAT      dump counters as json or prom to stderr at exit\n");
+    printf("                      and on SIGUSR1\n");
+    printf("  --uart-in PATH      feed UART0 RX from PATH (- for stdin)\n");
+    printf("  --uart-out PATH     send UART0 TX to PATH (- for stdout)\n");
+    printf("  --uart-socket PATH  connect UART0 to a Unix domain socket\n");
+    printf("  --code-flash PATH   back code flash with PATH, which is used as the\n");
+    printf("                      image unless one is given\n");
+    printf("  --data-flash PATH   back data flash with PATH\n");
+    printf("  --predecode DIR     load decoded code flash from a cache in DIR,\n");
+    printf("                      scanning and saving it on first use\n");
+    printf("  --checkpoint-interval CYCLES\n");
+    printf("                      checkpoint every CYCLES to allow stepping back\n");
+    printf("                      (b, g CYCLE, w ADDR while single-stepping)\n");
+    printf("                      Going back also rolls back --code-flash and\n");
+    printf("                      --data-flash files\n");
+    printf("  --checkpoints N     keep at most N checkpoints (default 64)\n");
+    printf("  --checkpoint-mem MB memory budget for checkpoints (default 64)\n");
+    printf("  --conformance CASES run CASES random single-instruction cases per\n");
+    printf("                      opcode row through live decoding and predecode\n");
+    printf("                      entries, print a digest per row and exit\n");
+    printf("  --seed N            seed for --conformance (default 1)\n");
+    printf("  --threads N         worker threads for --conformance (default: all CPUs)\n");
+}
+
+int main(int argc, char** argv)
 {
+    const char* image = NULL;
+    const char* code_flash = NULL;
+    const char* data_flash = NULL;
+    const char* predecode_dir = NULL;
+    const char* uart_in = NULL;
+    const char* uart_out = NULL;
+    const char* uart_socket = NULL;
+    bool run = false;
+    uint64_t clock_hz = 0;
+    const char* stats = NULL;
+    uint64_t checkpoint_interval = 0;
+    int checkpoints = 64;
+    size_t checkpoint_mb = 64;
+    uint64_t conformance = 0;
+    uint64_t seed = 1;
+    int threads = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--run") == 0)
+            run = true;
+        else if (strcmp(argv[i], "--clock") == 0 && i + 1 < argc)
+            clock_hz = parse_hz(argv[++i]);
+        else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc)
+            stats = argv[++i];
+        else if (strcmp(argv[i], "--uart-in") == 0 && i + 1 < argc)
+            uart_in = argv[++i];
+        else if (strcmp(argv[i], "--uart-out") == 0 && i + 1 < argc)
+            uart_out = argv[++i];
+        else if (strcmp(argv[i], "--uart-socket") == 0 && i + 1 < argc)
+            uart_socket = argv[++i];
+        else if (strcmp(argv[i], "--code-flash") == 0 && i + 1 < argc)
+            code_flash = argv[++i];
+        else if (strcmp(argv[i], "--data-flash") == 0 && i + 1 < argc)
+            data_flash = argv[++i];
+        else if (strcmp(argv[i], "--predecode") == 0 && i + 1 < argc)
+            predecode_dir = argv[++i];
+        else if (strcmp(argv[i], "--checkpoint-interval") == 0 && i + 1 < argc)
+            checkpoint_interval = strtoull(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--checkpoints") == 0 && i + 1 < argc)
+            checkpoints = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--checkpoint-mem") == 0 && i + 1 < argc)
+            checkpoint_mb = strtoull(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--conformance") == 0 && i + 1 < argc)
+            conformance = strtoull(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+            seed = strtoull(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        }
+        else
+            image = argv[i];
+    }
+    if (conformance)
+        return conformance_run(conformance, seed, threads, stdout) ? 1 : 0;
+
+    // The stepper reads its commands from stdin
+    if (!run && uart_in && strcmp(uart_in, "-") == 0) {
+        printf("--uart-in - needs --run\n");
+        return 1;
+    }
+
+    // Host input isn't recorded, so replaying past it would diverge
+    if (checkpoint_interval && (uart_in || uart_out || uart_socket)) {
+        printf("Reverse execution can't be combined with the UART\n");
+        return 1;
+    }
+    if ((stats && strcmp(stats, "json") != 0 && strcmp(stats, "prom") != 0) || checkpoints < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
     RL78_CPU *cpu = malloc(sizeof(RL78_CPU));
-    cpu_init(cpu);
+    if (cpu == NULL || !cpu_init(cpu))
+    {
+        printf("Couldn't allocate guest memory\n");
+        return 1;
+    }
 
-    if (!load_test_program(cpu))
+    if (code_flash && !flash_attach(cpu, CODE_FLASH_BASE, CODE_FLASH_SIZE, code_flash))
     {
-        printf("Couldn't load test.bin\n");
+        printf("Couldn't map %s\n", code_flash);
         return 1;
     }
+    if (data_flash && !flash_attach(cpu, DATA_FLASH_BASE, DATA_FLASH_SIZE, data_flash))
+    {
+        printf("Couldn't map %s\n", data_flash);
+        return 1;
+    }
+
+    // A mapped code flash file already holds the program
+    if (image == NULL && code_flash == NULL)
+        image = "./example_program/test.bin";
+    if (image && !load_program(cpu, image, code_flash != NULL))
+        return 1;
+
+    // Scanned after loading, the cache is keyed by the code flash contents
+    RL78_Predecode predecode;
+    if (predecode_dir) {
+        if (!predecode_open(&predecode, cpu, predecode_dir))
+        {
+            printf("Couldn't build predecode cache\n");
+            return 1;
+        }
+        cpu->predecode = &predecode;
+    }
 
-    for (;;) {
-        getchar();
-        cpu_step(cpu);
+    SAU_UART uart;
+    if (uart_in || uart_out || uart_socket) {
+        int rx_fd = -1, tx_fd = -1;
+        if (uart_socket)
+            rx_fd = tx_fd = uart_connect_socket(uart_socket);
+        else {
+            if (uart_in)
+                rx_fd = uart_open_path(uart_in, false);
+            if (uart_out)
+                tx_fd = uart_open_path(uart_out, true);
+        }
+
+        uart_init(&uart);
+        if ((uart_socket && rx_fd < 0) || (uart_in && rx_fd < 0) || (uart_out && tx_fd < 0)
+            || !uart_attach(&uart, rx_fd, tx_fd)) {
+            printf("Couldn't attach UART\n");
+            return 1;
+        }
+        cpu->uart = &uart;
+    }
+
+    RL78_Replay replay;
+    if (checkpoint_interval) {
+        if (!replay_init(&replay, cpu, checkpoint_interval, checkpoints, checkpoint_mb << 20))
+        {
+            printf("Couldn't set up checkpoints\n");
+            return 1;
+        }
+        cpu->replay = &replay;
     }
-     
+
+    RL78_Pace pace;
+    pace_init(&pace, run ? clock_hz : 0, cpu->cycles);
+    StatsFormat stats_format = stats && strcmp(stats, "prom") == 0 ? STATS_PROMETHEUS : STATS_JSON;
+    signal(SIGINT, on_interrupt);
+#ifdef SIGUSR1
+    signal(SIGUSR1, on_stats_request);
+#endif
+
+    while (!cpu->halted) {
+        if (interrupted) {
+            // With history to go back through, break into the stepper
+            if (!run || cpu->replay == NULL)
+                break;
+            interrupted = 0;
+            run = false;
+            dump_cpu_state(cpu);
+        }
+        if (run) {
+            cpu_run(cpu, cpu->cycles + RUN_QUANTUM);
+            pace_sync(&pace, cpu->cycles);
+        }
+        else if (!debug_command(cpu))
+            break;
+        // Host I/O only happens here, between quanta
+        if (cpu->uart)
+            uart_poll(cpu->uart, cpu);
+        if (stats_requested) {
+            stats_requested = 0;
+            stats_dump(&cpu->stats, stats_format, stderr);
+        }
+    }
+
+    if (cpu->uart)
+        uart_close(cpu->uart);
+    pace_report(&pace);
+    if (cpu->predecode)
+        predecode_close(cpu->predecode);
+    if (cpu->replay)
+        replay_free(cpu->replay);
+    if (stats)
+        stats_dump(&cpu->stats, stats_format, stderr);
+    cpu_free(cpu);
     free(cpu);
     return 0;
 }
@@ -0,0 +1,97 @@
+#include "pace.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+#define NS_PER_SEC 1000000000LL
+
+#ifndef _WIN32
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+static void sleep_until(int64_t ns)
+{
+    // A signal cuts the sleep short, the next quantum makes up for it
+    struct timespec ts = { .tv_sec = ns / NS_PER_SEC, .tv_nsec = ns % NS_PER_SEC };
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+#else
+
+static int64_t now_ns(void)
+{
+    return 0;
+}
+
+static void sleep_until(int64_t ns)
+{
+    (void)ns;
+}
+
+#endif
+
+// Guest time for a cycle delta, split so the multiply can't overflow
+static int64_t cycles_to_ns(uint64_t cycles, uint64_t hz)
+{
+    return (int64_t)(cycles / hz) * NS_PER_SEC + (int64_t)((cycles % hz) * NS_PER_SEC / hz);
+}
+
+void pace_init(RL78_Pace* pace, uint64_t hz, uint64_t cycles)
+{
+    memset(pace, 0, sizeof(*pace));
+    pace->hz = hz;
+    pace->base_cycles = cycles;
+    if (hz)
+        pace->base_ns = now_ns();
+}
+
+// Sleep until host time catches up with the guest. Called at quantum
+// boundaries only.
+void pace_sync(RL78_Pace* pace, uint64_t cycles)
+{
+    if (pace->hz == 0)
+        return;
+
+    int64_t guest_ns = pace->base_ns + cycles_to_ns(cycles - pace->base_cycles, pace->hz);
+    int64_t host_ns = now_ns();
+    int64_t drift = guest_ns - host_ns;
+
+    pace->samples++;
+    pace->drift_sum_ns += drift;
+    if (drift > pace->max_ahead_ns)
+        pace->max_ahead_ns = drift;
+    if (-drift > pace->max_behind_ns)
+        pace->max_behind_ns = -drift;
+
+    if (drift > 0) {
+        sleep_until(guest_ns);
+        pace->sleeps++;
+        pace->slept_ns += drift;
+    }
+    else if (-drift > PACE_MAX_LAG_NS) {
+        pace->base_cycles = cycles;
+        pace->base_ns = host_ns;
+        pace->resyncs++;
+    }
+}
+
+void pace_report(const RL78_Pace* pace)
+{
+    if (pace->hz == 0 || pace->samples == 0)
+        return;
+
+    printf("Pacing at %llu Hz over %llu quanta:\n", (unsigned long long)pace->hz, (unsigned long long)pace->samples);
+    printf("  mean drift  %+.1f us\n", (double)pace->drift_sum_ns / pace->samples / 1000.0);
+    printf("  max ahead   %.1f us\n", pace->max_ahead_ns / 1000.0);
+    printf("  max behind  %.1f us\n", pace->max_behind_ns / 1000.0);
+    printf("  sleeps      %llu (%.3f s requested)\n", (unsigned long long)pace->sleeps, (double)pace->slept_ns / NS_PER_SEC);
+    printf("  resyncs     %llu\n", (unsigned long long)pace->resyncs);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Falling further behind than this drops the backlog instead of running
+// flat out until the guest has caught up
+#define PACE_MAX_LAG_NS 50000000 // 50 ms
+
+// Keeps guest cycles in step with host wall-clock time at a given fCLK.
+// Host time is sampled once per call to pace_sync, never per instruction.
+typedef struct {
+    uint64_t hz; // Guest clock, 0 runs unthrottled
+    uint64_t base_cycles; // Guest cycle count at base_ns
+    int64_t base_ns; // Host monotonic time matching base_cycles
+
+    // Drift statistics, positive drift means the guest is ahead
+    uint64_t samples;
+    uint64_t sleeps;
+    uint64_t resyncs; // Times the host fell more than PACE_MAX_LAG_NS behind
+    int64_t slept_ns;
+    int64_t max_ahead_ns;
+    int64_t max_behind_ns;
+    int64_t drift_sum_ns;
+} RL78_Pace;
+
+void pace_init(RL78_Pace* pace, uint64_t hz, uint64_t cycles);
+void pace_sync(RL78_Pace* pace, uint64_t cycles);
+void pace_report(const RL78_Pace* pace);
@@ -0,0 +1,411 @@
+#include "predecode.h"
+#include "cpu.h"
+#include "instructions.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Interrupt vectors (0x0002 is reserved) run straight into the CALLT table
+#define VECTOR_FIRST 0x0004
+#define CALLT_LAST   0x00BE
+
+typedef struct {
+    RL78_PredecodeEntry* entries;
+    uint32_t* work;
+    uint32_t work_count;
+    RL78_PredecodeBlock* blocks;
+    uint32_t block_count;
+    uint32_t block_cap;
+    RL78_PredecodeEdge* edges;
+    uint32_t edge_count;
+    uint32_t edge_cap;
+    bool failed; // A block or edge couldn't be stored
+} Scan;
+
+uint64_t fnv1a64(const uint8_t* data, size_t len, uint64_t hash)
+{
+    for (size_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+static uint16_t read_word(const RL78_CPU* cpu, uint32_t addr20)
+{
+    return cpu->memory[addr20] | (cpu->memory[addr20 + 1] << 8);
+}
+
+// Index of the opcode byte for an instruction starting at addr20
+static uint32_t skip_es(const RL78_CPU* cpu, uint32_t addr20)
+{
+    return cpu->memory[addr20] == 0x11 ? addr20 + 1 : addr20;
+}
+
+static void push_target(Scan* scan, const RL78_CPU* cpu, uint32_t addr20)
+{
+    if (addr20 + 1 >= CODE_FLASH_SIZE)
+        return;
+    scan->work[scan->work_count++] = addr20;
+    // Flag the opcode so the block pass sees it once it has been decoded
+    scan->entries[skip_es(cpu, addr20)].flags |= PREDECODE_BLOCK_START;
+}
+
+static void add_edge(Scan* scan, uint32_t from, uint32_t to)
+{
+    if (scan->edge_count == scan->edge_cap) {
+        uint32_t cap = scan->edge_cap ? scan->edge_cap * 2 : 256;
+        RL78_PredecodeEdge* edges = realloc(scan->edges, cap * sizeof(*edges));
+        if (edges == NULL) {
+            scan->failed = true;
+            return;
+        }
+        scan->edges = edges;
+        scan->edge_cap = cap;
+    }
+    scan->edges[scan->edge_count++] = (RL78_PredecodeEdge){ from, to };
+}
+
+static void branch_to(Scan* scan, const RL78_CPU* cpu, uint32_t from, uint32_t to)
+{
+    to &= PC_MASK;
+    add_edge(scan, from, to);
+    push_target(scan, cpu, to);
+}
+
+// Decode the instruction at addr20 the way the scan does, returning its opcode address
+uint32_t predecode_insn(const RL78_CPU* cpu, uint32_t addr20, RL78_PredecodeEntry* entry)
+{
+    uint32_t at = skip_es(cpu, addr20);
+    const RL78_Opcode* op = decode_bytes(cpu->memory[at], cpu->memory[at + 1]);
+    entry->index = op->exec ? decode_index(op) : PREDECODE_NONE;
+    entry->flags = at != addr20 ? PREDECODE_ES : 0;
+    entry->cycles = op->cycles + (at != addr20);
+    return at;
+}
+
+// Follow one path of straight-line code until it leaves code flash, runs
+// into decoded code or ends in an unconditional transfer
+static void trace(Scan* scan, const RL78_CPU* cpu, uint32_t addr20)
+{
+    while (addr20 + 1 < CODE_FLASH_SIZE) {
+        RL78_PredecodeEntry decoded;
+        uint32_t at = predecode_insn(cpu, addr20, &decoded);
+        if (at + 1 >= CODE_FLASH_SIZE || scan->entries[at].index != PREDECODE_NONE
+            || decoded.index == PREDECODE_NONE)
+            return;
+
+        const RL78_Opcode* op = decode_entry(decoded.index);
+        RL78_PredecodeEntry* entry = &scan->entries[at];
+        entry->index = decoded.index;
+        entry->cycles = decoded.cycles;
+        entry->flags |= decoded.flags;
+
+        uint32_t next = at + op->size;
+        if (next > CODE_FLASH_SIZE - 2)
+            next = CODE_FLASH_SIZE - 2; // Keep operand reads inside flash
+        // Only branches use these, and they are long enough for both reads
+        int8_t disp8 = next >= 1 ? (int8_t)cpu->memory[next - 1] : 0;
+        int16_t disp16 = next >= 2 ? (int16_t)read_word(cpu, next - 2) : 0;
+
+        // Anything that queues its fall-through ends the trace; the
+        // worklist picks the next block up
+        bool queued = true;
+        if (op->exec == br_rel8) {
+            branch_to(scan, cpu, at, next + disp8);
+        }
+        else if (op->exec == br_rel16) {
+            branch_to(scan, cpu, at, next + disp16);
+        }
+        else if (op->exec == br_addr16) {
+            branch_to(scan, cpu, at, read_word(cpu, at + 1));
+        }
+        else if (op->exec == br_addr20) {
+            branch_to(scan, cpu, at, read_word(cpu, at + 1) | ((cpu->memory[at + 3] & 0x0F) << 16));
+        }
+        else if (op->exec == bcond_rel8 || op->exec == bcond_h_rel8 || op->exec == bit_test_branch) {
+            branch_to(scan, cpu, at, next + disp8);
+            push_target(scan, cpu, next);
+        }
+        else if (op->exec == call_rel16) {
+            branch_to(scan, cpu, at, next + disp16);
+            push_target(scan, cpu, next);
+        }
+        else if (op->exec == call_addr16) {
+            branch_to(scan, cpu, at, read_word(cpu, at + 1));
+            push_target(scan, cpu, next);
+        }
+        else if (op->exec == call_addr20) {
+            branch_to(scan, cpu, at, read_word(cpu, at + 1) | ((cpu->memory[at + 3] & 0x0F) << 16));
+            push_target(scan, cpu, next);
+        }
+        else if (op->exec == skip_cond) {
+            branch_to(scan, cpu, at, next + cpu_insn_size(cpu, next));
+            push_target(scan, cpu, next);
+        }
+        else if (op->exec == call_rp || op->exec == callt_inst || op->exec == brk_inst) {
+            // Targets come from registers or the vector tables, which are roots
+            push_target(scan, cpu, next);
+        }
+        else {
+            queued = op->exec == br_ax || op->exec == ret_inst || op->exec == retb_inst
+                || op->exec == reti_inst || op->exec == halt_inst || op->exec == stop_inst;
+        }
+
+        if (op->exec == br_rel8 || op->exec == br_rel16 || op->exec == br_addr16 || op->exec == br_addr20
+            || op->exec == br_ax || op->exec == ret_inst || op->exec == retb_inst || op->exec == reti_inst
+            || op->exec == halt_inst || op->exec == stop_inst)
+            entry->flags |= PREDECODE_BLOCK_END;
+        if (queued)
+            return;
+        addr20 = next;
+    }
+}
+
+// Split decoded code into straight-line blocks with their cycle totals
+static void build_blocks(Scan* scan, const RL78_CPU* cpu)
+{
+    for (uint32_t addr20 = 0; addr20 < CODE_FLASH_SIZE; addr20++) {
+        RL78_PredecodeEntry* entry = &scan->entries[addr20];
+        if (entry->index == PREDECODE_NONE || !(entry->flags & PREDECODE_BLOCK_START))
+            continue;
+
+        RL78_PredecodeBlock block = { addr20, 0, 0 };
+        uint32_t at = addr20;
+        for (;;) {
+            const RL78_PredecodeEntry* e = &scan->entries[at];
+            block.insns++;
+            block.cycles += e->cycles;
+            if (e->flags & PREDECODE_BLOCK_END)
+                break;
+            uint32_t next = at + decode_entry(e->index)->size;
+            if (next + 1 >= CODE_FLASH_SIZE)
+                break;
+            next = skip_es(cpu, next);
+            if (scan->entries[next].index == PREDECODE_NONE || (scan->entries[next].flags & PREDECODE_BLOCK_START))
+                break;
+            at = next;
+        }
+
+        if (scan->block_count == scan->block_cap) {
+            uint32_t cap = scan->block_cap ? scan->block_cap * 2 : 256;
+            RL78_PredecodeBlock* blocks = realloc(scan->blocks, cap * sizeof(*blocks));
+            if (blocks == NULL) {
+                scan->failed = true;
+                return;
+            }
+            scan->blocks = blocks;
+            scan->block_cap = cap;
+        }
+        scan->blocks[scan->block_count++] = block;
+    }
+}
+
+// Build the cache image in memory from a static scan of the start PC and
+// the reset, interrupt and CALLT vectors
+static bool scan_image(RL78_Predecode* pd, const RL78_CPU* cpu, uint64_t image_hash)
+{
+    Scan scan = { 0 };
+    scan.entries = malloc(CODE_FLASH_SIZE * sizeof(*scan.entries));
+    // Every decoded instruction queues at most two more addresses
+    scan.work = malloc((2 * CODE_FLASH_SIZE + 256) * sizeof(*scan.work));
+    if (!scan.entries || !scan.work) {
+        free(scan.entries);
+        free(scan.work);
+        return false;
+    }
+    for (uint32_t i = 0; i < CODE_FLASH_SIZE; i++)
+        scan.entries[i] = (RL78_PredecodeEntry){ PREDECODE_NONE, 0, 0 };
+
+    // The emulator starts at the current PC rather than the reset vector
+    push_target(&scan, cpu, GET_PC(cpu));
+    push_target(&scan, cpu, read_word(cpu, 0x0000));
+    for (uint32_t v = VECTOR_FIRST; v <= CALLT_LAST; v += 2) {
+        uint16_t target = read_word(cpu, v);
+        if (target != 0xFFFF && target >= CALLT_LAST + 2)
+            push_target(&scan, cpu, target);
+    }
+    while (scan.work_count)
+        trace(&scan, cpu, scan.work[--scan.work_count]);
+
+    // Start flags on bytes that never decoded mean nothing
+    for (uint32_t i = 0; i < CODE_FLASH_SIZE; i++) {
+        if (scan.entries[i].index == PREDECODE_NONE)
+            scan.entries[i].flags = 0;
+    }
+    build_blocks(&scan, cpu);
+
+    size_t size = sizeof(RL78_PredecodeHeader) + CODE_FLASH_SIZE * sizeof(RL78_PredecodeEntry)
+        + scan.block_count * sizeof(RL78_PredecodeBlock) + scan.edge_count * sizeof(RL78_PredecodeEdge);
+    uint8_t* image = scan.failed ? NULL : malloc(size);
+    if (image) {
+        RL78_PredecodeHeader header = { PREDECODE_MAGIC, PREDECODE_VERSION, CODE_FLASH_SIZE,
+            image_hash, decode_spec_hash(), scan.block_count, scan.edge_count };
+        uint8_t* p = image;
+        memcpy(p, &header, sizeof(header));
+        p += sizeof(header);
+        memcpy(p, scan.entries, CODE_FLASH_SIZE * sizeof(RL78_PredecodeEntry));
+        p += CODE_FLASH_SIZE * sizeof(RL78_PredecodeEntry);
+        memcpy(p, scan.blocks, scan.block_count * sizeof(RL78_PredecodeBlock));
+        p += scan.block_count * sizeof(RL78_PredecodeBlock);
+        memcpy(p, scan.edges, scan.edge_count * sizeof(RL78_PredecodeEdge));
+    }
+
+    free(scan.entries);
+    free(scan.work);
+    free(scan.blocks);
+    free(scan.edges);
+    if (!image)
+        return false;
+
+    pd->header = (RL78_PredecodeHeader*)image;
+    pd->size = size;
+    pd->mapped = false;
+    return true;
+}
+
+static void set_sections(RL78_Predecode* pd)
+{
+    uint8_t* p = (uint8_t*)pd->header + sizeof(RL78_PredecodeHeader);
+    pd->entry_count = pd->header->entry_count;
+    pd->entries = (RL78_PredecodeEntry*)p;
+    p += pd->entry_count * sizeof(RL78_PredecodeEntry);
+    pd->blocks = (RL78_PredecodeBlock*)p;
+    p += pd->header->block_count * sizeof(RL78_PredecodeBlock);
+    pd->edges = (RL78_PredecodeEdge*)p;
+}
+
+static bool header_valid(const RL78_PredecodeHeader* header, size_t size, uint64_t image_hash)
+{
+    return size >= sizeof(*header)
+        && memcmp(header->magic, PREDECODE_MAGIC, sizeof(PREDECODE_MAGIC)) == 0
+        && header->version == PREDECODE_VERSION
+        && header->entry_count == CODE_FLASH_SIZE
+        && header->image_hash == image_hash
+        && header->spec_hash == decode_spec_hash()
+        && size == sizeof(*header) + header->entry_count * sizeof(RL78_PredecodeEntry)
+            + (size_t)header->block_count * sizeof(RL78_PredecodeBlock)
+            + (size_t)header->edge_count * sizeof(RL78_PredecodeEdge);
+}
+
+// Indices are used to call through the decode table, so a corrupt or
+// foreign file must not get past this
+static bool entries_valid(const RL78_PredecodeHeader* header)
+{
+    const RL78_PredecodeEntry* entries = (const RL78_PredecodeEntry*)(header + 1);
+    for (uint32_t i = 0; i < header->entry_count; i++) {
+        if (entries[i].index != PREDECODE_NONE && entries[i].index >= MAP_COUNT * 256)
+            return false;
+    }
+    return true;
+}
+
+#ifndef _WIN32
+
+// Map an existing cache file privately, so invalidation never reaches disk
+static bool load_file(RL78_Predecode* pd, const char* path, uint64_t image_hash)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(RL78_PredecodeHeader))
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    if (!header_valid(map, (size_t)st.st_size, image_hash) || !entries_valid(map)) {
+        munmap(map, (size_t)st.st_size);
+        return false;
+    }
+    pd->header = map;
+    pd->size = (size_t)st.st_size;
+    pd->mapped = true;
+    return true;
+}
+
+// Write through a temporary file so concurrent runs never see a torn cache
+static void save_file(const RL78_Predecode* pd, const char* path)
+{
+    char tmp[4096];
+    int len = snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long)getpid());
+    if (len < 0 || (size_t)len >= sizeof(tmp))
+        return;
+    FILE* file = fopen(tmp, "wb");
+    if (file == NULL)
+        return;
+    bool ok = fwrite(pd->header, 1, pd->size, file) == pd->size;
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(tmp, path) != 0)
+        remove(tmp);
+}
+
+#else
+
+static bool load_file(RL78_Predecode* pd, const char* path, uint64_t image_hash)
+{
+    (void)pd; (void)path; (void)image_hash;
+    return false;
+}
+
+static void save_file(const RL78_Predecode* pd, const char* path)
+{
+    (void)pd; (void)path;
+}
+
+#endif
+
+// Use the cache for the current code flash contents in dir, scanning the
+// image and writing the cache first if there is none yet
+bool predecode_open(RL78_Predecode* pd, RL78_CPU* cpu, const char* dir)
+{
+    uint64_t image_hash = fnv1a64(&cpu->memory[CODE_FLASH_BASE], CODE_FLASH_SIZE, FNV1A64_INIT);
+    char path[4096];
+    int len = snprintf(path, sizeof(path), "%s/%016llx.rl78pd", dir, (unsigned long long)image_hash);
+    // A path that doesn't fit is never truncated, the scan just isn't cached
+    bool cacheable = len >= 0 && (size_t)len < sizeof(path);
+
+    if (!cacheable || !load_file(pd, path, image_hash)) {
+        if (!scan_image(pd, cpu, image_hash))
+            return false;
+        if (cacheable)
+            save_file(pd, path);
+    }
+    set_sections(pd);
+    return true;
+}
+
+void predecode_close(RL78_Predecode* pd)
+{
+#ifndef _WIN32
+    if (pd->mapped) {
+        munmap(pd->header, pd->size);
+        pd->header = NULL;
+        return;
+    }
+#endif
+    free(pd->header);
+    pd->header = NULL;
+}
+
+// Forget entries whose bytes may have changed. An instruction is at most
+// 5 bytes with its ES: prefix, so earlier starts can overlap the range too.
+void predecode_invalidate(RL78_Predecode* pd, uint32_t addr20, uint32_t len)
+{
+    uint32_t start = addr20 > 4 ? addr20 - 4 : 0;
+    uint32_t end = addr20 + len;
+    if (end > pd->entry_count)
+        end = pd->entry_count;
+    for (uint32_t i = start; i < end; i++)
+        pd->entries[i].index = PREDECODE_NONE;
+}
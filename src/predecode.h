@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+struct RL78_CPU;
+
+#define PREDECODE_MAGIC   "RL78PDC"
+#define PREDECODE_VERSION 1
+#define PREDECODE_NONE    0xFFFF // Entry index for bytes the scan never reached
+
+// Entry flags
+#define PREDECODE_ES          0x01 // Preceded by an ES: prefix
+#define PREDECODE_BLOCK_START 0x02 // Branch target, vector or fall-through after a branch
+#define PREDECODE_BLOCK_END   0x04 // Unconditional transfer of control
+
+// One entry per code flash byte, filled in at instruction (not prefix)
+// addresses
+typedef struct {
+    uint16_t index; // Decode table slot, see decode_entry()
+    uint8_t flags;
+    uint8_t cycles; // Base cycles including the ES: prefix
+} RL78_PredecodeEntry;
+
+// Straight-line run of decoded instructions
+typedef struct {
+    uint32_t start;
+    uint16_t insns;
+    uint16_t cycles; // Base cycles with no branches taken
+} RL78_PredecodeBlock;
+
+// Direct branch or call found by the scan
+typedef struct {
+    uint32_t from; // Address of the transferring instruction
+    uint32_t to;
+} RL78_PredecodeEdge;
+
+// On-disk layout: header, entries[entry_count], blocks[block_count],
+// edges[edge_count]
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t entry_count;
+    uint64_t image_hash; // FNV-1a over code flash
+    uint64_t spec_hash; // FNV-1a over the opcode spec the indices refer to
+    uint32_t block_count;
+    uint32_t edge_count;
+} RL78_PredecodeHeader;
+
+typedef struct RL78_Predecode {
+    RL78_PredecodeHeader* header;
+    RL78_PredecodeEntry* entries;
+    RL78_PredecodeBlock* blocks;
+    RL78_PredecodeEdge* edges;
+    uint32_t entry_count;
+    size_t size;
+    bool mapped; // Backed by the cache file rather than the heap
+} RL78_Predecode;
+
+uint64_t fnv1a64(const uint8_t* data, size_t len, uint64_t hash);
+#define FNV1A64_INIT 0xCBF29CE484222325ULL
+
+bool predecode_open(RL78_Predecode* pd, struct RL78_CPU* cpu, const char* dir);
+void predecode_close(RL78_Predecode* pd);
+void predecode_invalidate(RL78_Predecode* pd, uint32_t addr20, uint32_t len);
+uint32_t predecode_insn(const struct RL78_CPU* cpu, uint32_t addr20, RL78_PredecodeEntry* entry);
@@ -0,0 +1,267 @@
+#include "replay.h"
+#include "cpu.h"
+#include "predecode.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BANKS_BASE REG_BANK_ADDR(3)
+
+static Checkpoint* checkpoint_at(RL78_Replay* replay, int i)
+{
+    return &replay->ring[(replay->first + i) % replay->capacity];
+}
+
+// Undo logs are budgeted by capacity and freed rather than kept for reuse,
+// so one busy interval can't hold memory past the budget
+static void free_pages(RL78_Replay* replay, Checkpoint* ck)
+{
+    replay->used_bytes -= ck->page_cap * sizeof(ReplayPage);
+    free(ck->pages);
+    ck->pages = NULL;
+    ck->page_count = 0;
+    ck->page_cap = 0;
+}
+
+static void release(RL78_Replay* replay, Checkpoint* ck)
+{
+    free_pages(replay, ck);
+    replay->used_bytes -= sizeof(RL78_CPU);
+}
+
+static void drop_oldest(RL78_Replay* replay)
+{
+    release(replay, checkpoint_at(replay, 0));
+    replay->first = (replay->first + 1) % replay->capacity;
+    replay->count--;
+}
+
+// Without memory for the undo log the checkpoints can't be trusted, so
+// forget them all and let the run carry on without history
+static void turn_off(RL78_Replay* replay)
+{
+    while (replay->count)
+        drop_oldest(replay);
+    replay->off = true;
+    printf("Out of memory for checkpoints, stepping back is off\n");
+}
+
+// Keep the newest checkpoint even when it alone is over budget
+static void enforce_budget(RL78_Replay* replay)
+{
+    while (replay->used_bytes > replay->max_bytes && replay->count > 1)
+        drop_oldest(replay);
+}
+
+static void take_checkpoint(RL78_Replay* replay, RL78_CPU* cpu)
+{
+    if (replay->count == replay->capacity)
+        drop_oldest(replay);
+
+    Checkpoint* ck = checkpoint_at(replay, replay->count);
+    if (ck->state == NULL)
+        ck->state = malloc(sizeof(RL78_CPU));
+    if (ck->state == NULL) {
+        turn_off(replay);
+        return;
+    }
+    replay->count++;
+    ck->cycles = cpu->cycles;
+    memcpy(ck->state, cpu, sizeof(RL78_CPU));
+    memcpy(ck->banks, &cpu->memory[BANKS_BASE], sizeof(ck->banks));
+    ck->page_count = 0;
+
+    replay->used_bytes += sizeof(RL78_CPU);
+    replay->gen++;
+    enforce_budget(replay);
+}
+
+// Scheduled so checkpoints land on the same instruction boundaries when
+// the run is repeated
+static void checkpoint_event(RL78_CPU* cpu, void* ctx)
+{
+    RL78_Replay* replay = ctx;
+    if (replay->off)
+        return;
+    sched_add(&cpu->sched, cpu->cycles + replay->interval, checkpoint_event, replay);
+    take_checkpoint(replay, cpu);
+}
+
+bool replay_init(RL78_Replay* replay, RL78_CPU* cpu, uint64_t interval, int capacity, size_t max_bytes)
+{
+    memset(replay, 0, sizeof(*replay));
+    replay->ring = calloc(capacity, sizeof(Checkpoint));
+    if (replay->ring == NULL)
+        return false;
+    replay->interval = interval;
+    replay->capacity = capacity;
+    replay->max_bytes = max_bytes;
+    replay->watch_cycles = REPLAY_NO_WRITE;
+
+    sched_add(&cpu->sched, cpu->cycles + interval, checkpoint_event, replay);
+    take_checkpoint(replay, cpu);
+    return !replay->off;
+}
+
+void replay_free(RL78_Replay* replay)
+{
+    for (int i = 0; i < replay->capacity; i++) {
+        free(replay->ring[i].state);
+        free(replay->ring[i].pages);
+    }
+    free(replay->ring);
+    replay->ring = NULL;
+}
+
+// Make room for one more page in the newest checkpoint's undo log, giving
+// up older checkpoints if that is what it takes
+static bool grow_pages(RL78_Replay* replay, Checkpoint* ck)
+{
+    uint32_t cap = ck->page_cap ? ck->page_cap * 2 : 16;
+    for (;;) {
+        ReplayPage* pages = realloc(ck->pages, cap * sizeof(ReplayPage));
+        if (pages) {
+            ck->pages = pages;
+            replay->used_bytes += (cap - ck->page_cap) * sizeof(ReplayPage);
+            ck->page_cap = cap;
+            return true;
+        }
+        if (replay->count <= 1)
+            return false;
+        drop_oldest(replay);
+    }
+}
+
+// Called before every store to guest memory
+void replay_note_write(RL78_Replay* replay, const RL78_CPU* cpu, uint32_t addr20, uint32_t len)
+{
+    if (replay->off)
+        return;
+    if (replay->watching && replay->watch_addr - addr20 < len)
+        replay->watch_cycles = cpu->cycles;
+
+    uint32_t last = (addr20 + len - 1) >> REPLAY_PAGE_SHIFT;
+    for (uint32_t page = addr20 >> REPLAY_PAGE_SHIFT; page <= last; page++) {
+        if (replay->page_gen[page] == replay->gen)
+            continue;
+        replay->page_gen[page] = replay->gen;
+
+        Checkpoint* ck = checkpoint_at(replay, replay->count - 1);
+        if (ck->page_count == ck->page_cap && !grow_pages(replay, ck)) {
+            turn_off(replay);
+            return;
+        }
+        ReplayPage* saved = &ck->pages[ck->page_count++];
+        saved->page = page;
+        memcpy(saved->data, &cpu->memory[page << REPLAY_PAGE_SHIFT], REPLAY_PAGE_SIZE);
+    }
+    enforce_budget(replay);
+}
+
+// Roll memory and CPU state back to checkpoint i and forget newer ones.
+// Flash backed by a file (flash_attach) is shared with it, so the file is
+// rolled back too and keeps matching what the guest sees.
+static void restore(RL78_Replay* replay, RL78_CPU* cpu, int i)
+{
+    // Newest first, so the oldest copy of a page is the one left standing
+    for (int j = replay->count - 1; j >= i; j--) {
+        Checkpoint* ck = checkpoint_at(replay, j);
+        for (uint32_t p = 0; p < ck->page_count; p++) {
+            uint32_t addr = ck->pages[p].page << REPLAY_PAGE_SHIFT;
+            memcpy(&cpu->memory[addr], ck->pages[p].data, REPLAY_PAGE_SIZE);
+            if (cpu->predecode && IS_CODE_FLASH(addr))
+                predecode_invalidate(cpu->predecode, addr, REPLAY_PAGE_SIZE);
+        }
+        if (j > i)
+            release(replay, ck);
+    }
+
+    Checkpoint* ck = checkpoint_at(replay, i);
+    free_pages(replay, ck);
+    replay->count = i + 1;
+    replay->gen++;
+    memcpy(&cpu->memory[BANKS_BASE], ck->banks, sizeof(ck->banks));
+
+    // Host side attachments and the counters stay as they are
+    RL78_CPU keep;
+    memcpy(&keep, cpu, sizeof(keep));
+    memcpy(cpu, ck->state, sizeof(RL78_CPU));
+    cpu->memory = keep.memory;
+    cpu->uart = keep.uart;
+    cpu->predecode = keep.predecode;
+    cpu->replay = keep.replay;
+    cpu->write_log = keep.write_log;
+    cpu->stats = keep.stats;
+    cpu_sync_bank(cpu);
+}
+
+// Newest checkpoint taken at or before cycles, -1 if they are all later
+static int nearest(const RL78_Replay* replay, uint64_t cycles, bool inclusive)
+{
+    for (int i = replay->count - 1; i >= 0; i--) {
+        uint64_t at = replay->ring[(replay->first + i) % replay->capacity].cycles;
+        if (at < cycles || (inclusive && at == cycles))
+            return i;
+    }
+    return -1;
+}
+
+// Move to the first instruction boundary at or after cycles
+bool replay_seek(RL78_Replay* replay, RL78_CPU* cpu, uint64_t cycles)
+{
+    if (cycles < cpu->cycles) {
+        int i = nearest(replay, cycles, true);
+        if (i < 0)
+            return false;
+        restore(replay, cpu, i);
+    }
+    cpu_run(cpu, cycles);
+    return true;
+}
+
+// Go back to the start of the previous instruction
+bool replay_step_back(RL78_Replay* replay, RL78_CPU* cpu)
+{
+    uint64_t target = cpu->cycles;
+    int i = nearest(replay, target, false);
+    if (i < 0)
+        return false;
+
+    restore(replay, cpu, i);
+    uint64_t prev = cpu->cycles;
+    while (cpu->cycles < target && !cpu->halted) {
+        uint32_t pc = cpu->PC;
+        prev = cpu->cycles;
+        cpu_step(cpu);
+        sched_run_due(&cpu->sched, cpu);
+        if (cpu->cycles == prev && cpu->PC == pc)
+            break; // Not advancing, stay where it stuck
+    }
+    return replay_seek(replay, cpu, prev);
+}
+
+// Go back to just before the last instruction that wrote addr20. Each
+// checkpoint interval is replayed with a watch on the address, newest
+// first, until one of them contains a write.
+bool replay_find_write(RL78_Replay* replay, RL78_CPU* cpu, uint32_t addr20)
+{
+    uint64_t now = cpu->cycles;
+    uint64_t end = now;
+
+    replay->watch_addr = addr20;
+    for (int i = nearest(replay, end, false); i >= 0 && !replay->off; i--) {
+        restore(replay, cpu, i);
+        uint64_t start = cpu->cycles;
+
+        replay->watch_cycles = REPLAY_NO_WRITE;
+        replay->watching = true;
+        cpu_run(cpu, end);
+        replay->watching = false;
+
+        if (replay->watch_cycles < end)
+            return replay_seek(replay, cpu, replay->watch_cycles);
+        end = start;
+    }
+    replay_seek(replay, cpu, now);
+    return false;
+}
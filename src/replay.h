@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+struct RL78_CPU;
+
+// Undo granularity. RL78 data is scattered over a small RAM, so small
+// pages keep each checkpoint's log close to what was actually written.
+#define REPLAY_PAGE_SHIFT 8
+#define REPLAY_PAGE_SIZE  (1u << REPLAY_PAGE_SHIFT)
+#define REPLAY_PAGES      (0x100000 >> REPLAY_PAGE_SHIFT)
+
+#define REPLAY_NO_WRITE UINT64_MAX
+
+// Old contents of a page, saved on its first write after a checkpoint
+typedef struct {
+    uint32_t page;
+    uint8_t data[REPLAY_PAGE_SIZE];
+} ReplayPage;
+
+typedef struct {
+    uint64_t cycles;
+    void* state; // Copy of RL78_CPU at the checkpoint
+    uint8_t banks[32]; // Register banks, which handlers write directly
+    ReplayPage* pages; // Undo log up to the next checkpoint
+    uint32_t page_count;
+    uint32_t page_cap;
+} Checkpoint;
+
+// Periodic checkpoints with copy-on-first-write undo logs. Going back
+// restores the nearest earlier checkpoint and runs forward again, which is
+// exact because the guest is deterministic between host inputs.
+typedef struct RL78_Replay {
+    uint64_t interval; // Cycles between checkpoints
+    size_t max_bytes; // Budget for saved pages and states
+    size_t used_bytes;
+    Checkpoint* ring;
+    int capacity;
+    int first; // Oldest checkpoint
+    int count;
+    uint32_t gen; // Current checkpoint generation
+    uint32_t page_gen[REPLAY_PAGES]; // Generation each page was last saved in
+    uint32_t watch_addr; // Address tracked by replay_find_write
+    uint64_t watch_cycles; // Start of the last instruction that wrote it
+    bool watching;
+    bool off; // Out of memory, no more history is recorded
+} RL78_Replay;
+
+bool replay_init(RL78_Replay* replay, struct RL78_CPU* cpu, uint64_t interval, int capacity, size_t max_bytes);
+void replay_free(RL78_Replay* replay);
+void replay_note_write(RL78_Replay* replay, const struct RL78_CPU* cpu, uint32_t addr20, uint32_t len);
+
+bool replay_seek(RL78_Replay* replay, struct RL78_CPU* cpu, uint64_t cycles);
+bool replay_step_back(RL78_Replay* replay, struct RL78_CPU* cpu);
+bool replay_find_write(RL78_Replay* replay, struct RL78_CPU* cpu, uint32_t addr20);
@@ -0,0 +1,72 @@
+#include "sched.h"
+#include "cpu.h"
+#include <stdio.h>
+
+static void update_next(RL78_Sched* sched)
+{
+    sched->next = UINT64_MAX;
+    for (int i = 0; i < sched->count; i++) {
+        if (sched->events[i].when < sched->next)
+            sched->next = sched->events[i].when;
+    }
+}
+
+void sched_init(RL78_Sched* sched)
+{
+    sched->count = 0;
+    sched->next = UINT64_MAX;
+}
+
+bool sched_add(RL78_Sched* sched, uint64_t when, SchedFn fn, void* ctx)
+{
+    if (sched->count == SCHED_MAX_EVENTS) {
+        printf("Scheduler full, dropping event\n");
+        return false;
+    }
+    sched->events[sched->count++] = (SchedEvent){ when, fn, ctx };
+    if (when < sched->next)
+        sched->next = when;
+    return true;
+}
+
+void sched_cancel(RL78_Sched* sched, SchedFn fn, void* ctx)
+{
+    for (int i = 0; i < sched->count; i++) {
+        if (sched->events[i].fn == fn && sched->events[i].ctx == ctx) {
+            sched->events[i--] = sched->events[--sched->count];
+        }
+    }
+    update_next(sched);
+}
+
+bool sched_pending(const RL78_Sched* sched, SchedFn fn, void* ctx)
+{
+    for (int i = 0; i < sched->count; i++) {
+        if (sched->events[i].fn == fn && sched->events[i].ctx == ctx)
+            return true;
+    }
+    return false;
+}
+
+// Earliest deadline, or limit if nothing is due before it
+uint64_t sched_next(const RL78_Sched* sched, uint64_t limit)
+{
+    return sched->next < limit ? sched->next : limit;
+}
+
+void sched_run_due(RL78_Sched* sched, RL78_CPU* cpu)
+{
+    // Callbacks may post new events, so pick one due event at a time
+    while (sched->next <= cpu->cycles) {
+        int due = 0;
+        for (int i = 1; i < sched->count; i++) {
+            if (sched->events[i].when < sched->events[due].when)
+                due = i;
+        }
+
+        SchedEvent ev = sched->events[due];
+        sched->events[due] = sched->events[--sched->count];
+        update_next(sched);
+        ev.fn(cpu, ev.ctx);
+    }
+}
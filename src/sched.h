@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SCHED_MAX_EVENTS 16
+
+struct RL78_CPU;
+
+// Callback run once the CPU cycle counter reaches the event's deadline
+typedef void (*SchedFn)(struct RL78_CPU* cpu, void* ctx);
+
+typedef struct {
+    uint64_t when; // Deadline in CPU cycles
+    SchedFn fn;
+    void* ctx;
+} SchedEvent;
+
+// Cycle based event queue. Peripherals post events here instead of being
+// ticked every instruction; the run loop only stops at the next deadline.
+typedef struct {
+    SchedEvent events[SCHED_MAX_EVENTS];
+    int count;
+    uint64_t next; // Earliest deadline, UINT64_MAX when empty
+} RL78_Sched;
+
+void sched_init(RL78_Sched* sched);
+bool sched_add(RL78_Sched* sched, uint64_t when, SchedFn fn, void* ctx);
+void sched_cancel(RL78_Sched* sched, SchedFn fn, void* ctx);
+bool sched_pending(const RL78_Sched* sched, SchedFn fn, void* ctx);
+uint64_t sched_next(const RL78_Sched* sched, uint64_t limit);
+void sched_run_due(RL78_Sched* sched, struct RL78_CPU* cpu);
@@ -0,0 +1,96 @@
+#include "stats.h"
+
+static const char* mem_names[STAT_MEM_COUNT] = {
+    "saddr", "sfr", "ram", "flash", "indirect", "other"
+};
+
+// Every field is a uint64_t counter, so merging is a flat element-wise sum
+void stats_merge(RL78_Stats* dst, const RL78_Stats* src)
+{
+    uint64_t* d = (uint64_t*)dst;
+    const uint64_t* s = (const uint64_t*)src;
+    for (size_t i = 0; i < sizeof(RL78_Stats) / sizeof(uint64_t); i++)
+        d[i] += s[i];
+}
+
+static uint64_t total_instructions(const RL78_Stats* stats)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < 256; i++)
+        total += stats->opcode[i];
+    return total;
+}
+
+static double hit_rate(const RL78_Stats* stats)
+{
+    uint64_t lookups = stats->decode_hits + stats->decode_misses;
+    return lookups ? (double)stats->decode_hits / lookups : 0.0;
+}
+
+static void dump_json_opcodes(const uint64_t* counts, FILE* out)
+{
+    const char* sep = "";
+    fprintf(out, "{");
+    for (int i = 0; i < 256; i++) {
+        if (counts[i] == 0)
+            continue;
+        fprintf(out, "%s\"0x%02X\": %llu", sep, i, (unsigned long long)counts[i]);
+        sep = ", ";
+    }
+    fprintf(out, "}");
+}
+
+static void dump_json(const RL78_Stats* stats, FILE* out)
+{
+    fprintf(out, "{\n");
+    fprintf(out, "  \"instructions\": %llu,\n", (unsigned long long)total_instructions(stats));
+    fprintf(out, "  \"es_prefix\": %llu,\n", (unsigned long long)stats->es_prefix);
+    fprintf(out, "  \"decode\": {\"hits\": %llu, \"misses\": %llu, \"hit_rate\": %.4f},\n",
+        (unsigned long long)stats->decode_hits, (unsigned long long)stats->decode_misses, hit_rate(stats));
+    fprintf(out, "  \"memory\": {");
+    for (int i = 0; i < STAT_MEM_COUNT; i++)
+        fprintf(out, "%s\"%s\": %llu", i ? ", " : "", mem_names[i], (unsigned long long)stats->mem[i]);
+    fprintf(out, "},\n");
+    fprintf(out, "  \"interrupts\": %llu,\n", (unsigned long long)stats->interrupts);
+    fprintf(out, "  \"idle_cycles\": %llu,\n", (unsigned long long)stats->idle_cycles);
+    fprintf(out, "  \"opcodes\": ");
+    dump_json_opcodes(stats->opcode, out);
+    fprintf(out, ",\n  \"opcodes_61\": ");
+    dump_json_opcodes(stats->opcode_61, out);
+    fprintf(out, "\n}\n");
+}
+
+static void dump_prometheus(const RL78_Stats* stats, FILE* out)
+{
+    fprintf(out, "# TYPE rl78_instructions_total counter\n");
+    for (int i = 0; i < 256; i++) {
+        if (stats->opcode[i])
+            fprintf(out, "rl78_instructions_total{opcode=\"0x%02X\"} %llu\n", i, (unsigned long long)stats->opcode[i]);
+    }
+    fprintf(out, "# TYPE rl78_instructions_61_total counter\n");
+    for (int i = 0; i < 256; i++) {
+        if (stats->opcode_61[i])
+            fprintf(out, "rl78_instructions_61_total{opcode=\"0x%02X\"} %llu\n", i, (unsigned long long)stats->opcode_61[i]);
+    }
+    fprintf(out, "# TYPE rl78_es_prefix_total counter\n");
+    fprintf(out, "rl78_es_prefix_total %llu\n", (unsigned long long)stats->es_prefix);
+    fprintf(out, "# TYPE rl78_memory_accesses_total counter\n");
+    for (int i = 0; i < STAT_MEM_COUNT; i++)
+        fprintf(out, "rl78_memory_accesses_total{region=\"%s\"} %llu\n", mem_names[i], (unsigned long long)stats->mem[i]);
+    fprintf(out, "# TYPE rl78_decode_total counter\n");
+    fprintf(out, "rl78_decode_total{result=\"hit\"} %llu\n", (unsigned long long)stats->decode_hits);
+    fprintf(out, "rl78_decode_total{result=\"miss\"} %llu\n", (unsigned long long)stats->decode_misses);
+    fprintf(out, "# TYPE rl78_interrupts_total counter\n");
+    fprintf(out, "rl78_interrupts_total %llu\n", (unsigned long long)stats->interrupts);
+    fprintf(out, "# TYPE rl78_idle_cycles_total counter\n");
+    fprintf(out, "rl78_idle_cycles_total %llu\n", (unsigned long long)stats->idle_cycles);
+}
+
+void stats_dump(const RL78_Stats* stats, StatsFormat format, FILE* out)
+{
+    if (format == STATS_PROMETHEUS)
+        dump_prometheus(stats, out);
+    else
+        dump_json(stats, out);
+    fflush(out);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Per-instance event counters. Build with -DRL78_NO_STATS to compile the
+// hot path increments out.
+#ifndef RL78_NO_STATS
+#define STAT_INC(cpu, field) ((cpu)->stats.field++)
+#define STAT_ADD(cpu, field, n) ((cpu)->stats.field += (n))
+#else
+#define STAT_INC(cpu, field) ((void)0)
+#define STAT_ADD(cpu, field, n) ((void)0)
+#endif
+
+// Memory access counters. SFR, RAM, flash and other count every data
+// access by target address. saddr and indirect count the addressing mode
+// on top of that.
+enum {
+    STAT_MEM_SADDR,
+    STAT_MEM_SFR,
+    STAT_MEM_RAM,
+    STAT_MEM_FLASH,
+    STAT_MEM_INDIRECT,
+    STAT_MEM_OTHER,
+    STAT_MEM_COUNT
+};
+
+typedef struct {
+    uint64_t opcode[256]; // Instructions retired by first opcode byte
+    uint64_t opcode_61[256]; // 0x61 map instructions by second byte
+    uint64_t es_prefix;
+    uint64_t mem[STAT_MEM_COUNT];
+    uint64_t decode_hits; // Served from the predecoded cache
+    uint64_t decode_misses; // Decoded from memory
+    uint64_t interrupts;
+    uint64_t idle_cycles; // Skipped while halted
+} RL78_Stats;
+
+typedef enum {
+    STATS_JSON,
+    STATS_PROMETHEUS
+} StatsFormat;
+
+void stats_merge(RL78_Stats* dst, const RL78_Stats* src);
+void stats_dump(const RL78_Stats* stats, StatsFormat format, FILE* out);
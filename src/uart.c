@@ -0,0 +1,382 @@
+#include "uart.h"
+#include "cpu.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
+#define RING_MASK (UART_RING_SIZE - 1)
+
+// Start bit, 8 data bits, stop bit
+#define UART_FRAME_BITS 10
+
+static uint32_t ring_used(const UART_Ring* ring)
+{
+    return ring->head - ring->tail;
+}
+
+static bool ring_put(UART_Ring* ring, uint8_t data)
+{
+    if (ring_used(ring) == UART_RING_SIZE)
+        return false;
+    ring->buf[ring->head++ & RING_MASK] = data;
+    return true;
+}
+
+static bool ring_get(UART_Ring* ring, uint8_t* data)
+{
+    if (ring_used(ring) == 0)
+        return false;
+    *data = ring->buf[ring->tail++ & RING_MASK];
+    return true;
+}
+
+// Cycles per frame. A bit takes 2^PRS * (divider + 1) * 2 clocks.
+static uint64_t frame_cycles(const RL78_CPU* cpu, uint32_t sdr_high)
+{
+    uint8_t prs = cpu->memory[UART_SPS0] & 0x0F;
+    uint32_t divider = (cpu->memory[sdr_high] >> 1) + 1;
+    return (uint64_t)(2u << prs) * divider * UART_FRAME_BITS;
+}
+
+static void tx_done(RL78_CPU* cpu, void* ctx);
+static void rx_done(RL78_CPU* cpu, void* ctx);
+
+static void tx_start(SAU_UART* uart, RL78_CPU* cpu, uint8_t data)
+{
+    uart->tx_shift = data;
+    uart->tx_busy = true;
+    sched_add(&cpu->sched, cpu->cycles + frame_cycles(cpu, UART_SDR00H), tx_done, uart);
+}
+
+static void tx_done(RL78_CPU* cpu, void* ctx)
+{
+    SAU_UART* uart = ctx;
+    if (!ring_put(&uart->tx, uart->tx_shift))
+        uart->tx_dropped++;
+
+    uart->tx_busy = false;
+    if (uart->tx_buf_full) {
+        uart->tx_buf_full = false;
+        tx_start(uart, cpu, uart->tx_buf);
+    }
+}
+
+// Shift in the next host byte one frame from now, if any are waiting
+static void rx_kick(SAU_UART* uart, RL78_CPU* cpu)
+{
+    if (!(uart->se & 0x02) || ring_used(&uart->rx) == 0 || sched_pending(&cpu->sched, rx_done, uart))
+        return;
+    sched_add(&cpu->sched, cpu->cycles + frame_cycles(cpu, UART_SDR01H), rx_done, uart);
+}
+
+static void rx_done(RL78_CPU* cpu, void* ctx)
+{
+    SAU_UART* uart = ctx;
+    uint8_t data;
+    if (!(uart->se & 0x02) || !ring_get(&uart->rx, &data))
+        return;
+
+    if (uart->rx_full)
+        uart->rx_overrun = true;
+    uart->rxd = data;
+    uart->rx_full = true;
+    rx_kick(uart, cpu);
+}
+
+void uart_init(SAU_UART* uart)
+{
+    memset(uart, 0, sizeof(*uart));
+    uart->rx_fd = -1;
+    uart->tx_fd = -1;
+    uart->epoll_fd = -1;
+}
+
+bool uart_owns(uint32_t addr20)
+{
+    switch (addr20)
+    {
+    case UART_TXD0:
+    case UART_RXD0:
+    case UART_SSR00:
+    case UART_SSR01:
+    case UART_SIR00:
+    case UART_SIR01:
+    case UART_SE0:
+    case UART_SS0:
+    case UART_ST0:
+        return true;
+    default:
+        return false;
+    }
+}
+
+uint8_t uart_read(SAU_UART* uart, RL78_CPU* cpu, uint32_t addr20)
+{
+    switch (addr20)
+    {
+    case UART_RXD0:
+        uart->rx_full = false;
+        return uart->rxd;
+    case UART_SSR00:
+        return (uart->tx_busy ? UART_SSR_TSF : 0) | (uart->tx_buf_full ? UART_SSR_BFF : 0);
+    case UART_SSR01:
+        return (uart->rx_full ? UART_SSR_BFF : 0) | (uart->rx_overrun ? UART_SSR_OVF : 0);
+    case UART_SE0:
+        return uart->se;
+    case UART_SIR00:
+    case UART_SIR01:
+    case UART_SS0:
+    case UART_ST0:
+        return 0; // Trigger registers read as zero
+    default:
+        return cpu->memory[addr20];
+    }
+}
+
+void uart_write(SAU_UART* uart, RL78_CPU* cpu, uint32_t addr20, uint8_t data)
+{
+    switch (addr20)
+    {
+    case UART_TXD0:
+        cpu->memory[addr20] = data;
+        if (!(uart->se & 0x01))
+            break;
+        if (!uart->tx_busy)
+            tx_start(uart, cpu, data);
+        else if (!uart->tx_buf_full) {
+            uart->tx_buf = data;
+            uart->tx_buf_full = true;
+        }
+        // Writing while both are full loses the byte, as on hardware
+        break;
+    case UART_SIR01:
+        if (data & UART_SSR_OVF)
+            uart->rx_overrun = false;
+        break;
+    case UART_SS0:
+        uart->se |= data & 0x03;
+        rx_kick(uart, cpu);
+        break;
+    case UART_ST0:
+        uart->se &= ~data;
+        if (data & 0x02)
+            sched_cancel(&cpu->sched, rx_done, uart);
+        break;
+    case UART_RXD0:
+    case UART_SSR00:
+    case UART_SSR01:
+    case UART_SIR00:
+    case UART_SE0:
+        break; // Read-only or no flags to clear
+    default:
+        cpu->memory[addr20] = data;
+        break;
+    }
+}
+
+#ifdef __linux__
+
+static bool set_nonblocking(int fd, int* saved_flags)
+{
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0)
+        return false;
+    *saved_flags = flags;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+bool uart_attach(SAU_UART* uart, int rx_fd, int tx_fd)
+{
+    uart->epoll_fd = epoll_create1(0);
+    if (uart->epoll_fd < 0)
+        return false;
+
+    if (rx_fd >= 0) {
+        if (!set_nonblocking(rx_fd, &uart->rx_flags))
+            return false;
+        struct epoll_event ev = { .events = EPOLLIN, .data.fd = rx_fd };
+        if (epoll_ctl(uart->epoll_fd, EPOLL_CTL_ADD, rx_fd, &ev) == 0)
+            uart->rx_pollable = true;
+        else if (errno != EPERM) // Regular files are always readable
+            return false;
+        uart->rx_fd = rx_fd;
+    }
+    if (tx_fd >= 0) {
+        if (tx_fd == rx_fd)
+            uart->tx_flags = uart->rx_flags;
+        else if (!set_nonblocking(tx_fd, &uart->tx_flags))
+            return false;
+        uart->tx_fd = tx_fd;
+    }
+    return true;
+}
+
+// Terminals and pipes are reopened rather than shared, so the non-blocking
+// mode uart_attach sets stays off the descriptors stdio uses. Regular files
+// ignore O_NONBLOCK and have to share stdio's file offset.
+static int open_stdio(int fd, int flags)
+{
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+        return dup(fd);
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+    return open(path, flags);
+}
+
+// "-" selects stdin / stdout
+int uart_open_path(const char* path, bool output)
+{
+    if (strcmp(path, "-") == 0)
+        return output ? open_stdio(STDOUT_FILENO, O_WRONLY) : open_stdio(STDIN_FILENO, O_RDONLY);
+    return output ? open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644) : open(path, O_RDONLY);
+}
+
+int uart_connect_socket(const char* path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return -1;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Read as much as the RX ring can take in at most two contiguous chunks
+static void host_read(SAU_UART* uart)
+{
+    while (ring_used(&uart->rx) < UART_RING_SIZE) {
+        uint32_t offset = uart->rx.head & RING_MASK;
+        uint32_t space = UART_RING_SIZE - ring_used(&uart->rx);
+        if (space > UART_RING_SIZE - offset)
+            space = UART_RING_SIZE - offset;
+
+        ssize_t n = read(uart->rx_fd, &uart->rx.buf[offset], space);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                // End of input, stop polling it
+                if (uart->rx_pollable)
+                    epoll_ctl(uart->epoll_fd, EPOLL_CTL_DEL, uart->rx_fd, NULL);
+                if (uart->rx_fd != uart->tx_fd) {
+                    fcntl(uart->rx_fd, F_SETFL, uart->rx_flags);
+                    close(uart->rx_fd);
+                }
+                uart->rx_pollable = false;
+                uart->rx_fd = -1;
+            }
+            return;
+        }
+        uart->rx.head += (uint32_t)n;
+        if ((uint32_t)n < space)
+            return;
+    }
+}
+
+// Write out the TX ring, leaving whatever the host can't take right now
+static void host_write(SAU_UART* uart)
+{
+    while (ring_used(&uart->tx) > 0) {
+        uint32_t offset = uart->tx.tail & RING_MASK;
+        uint32_t len = ring_used(&uart->tx);
+        if (len > UART_RING_SIZE - offset)
+            len = UART_RING_SIZE - offset;
+
+        ssize_t n = write(uart->tx_fd, &uart->tx.buf[offset], len);
+        if (n <= 0)
+            return;
+        uart->tx.tail += (uint32_t)n;
+    }
+}
+
+// Exchange bytes with the host. Only called between run quanta, so the
+// instruction loop never makes system calls.
+void uart_poll(SAU_UART* uart, RL78_CPU* cpu)
+{
+    if (uart->rx_fd >= 0) {
+        bool readable = !uart->rx_pollable;
+        if (uart->rx_pollable) {
+            struct epoll_event ev;
+            readable = epoll_wait(uart->epoll_fd, &ev, 1, 0) > 0;
+        }
+        if (readable)
+            host_read(uart);
+        rx_kick(uart, cpu);
+    }
+    if (uart->tx_fd >= 0)
+        host_write(uart);
+}
+
+void uart_close(SAU_UART* uart)
+{
+    // Frames still on the wire count as sent
+    if (uart->tx_busy)
+        ring_put(&uart->tx, uart->tx_shift);
+    if (uart->tx_buf_full)
+        ring_put(&uart->tx, uart->tx_buf);
+
+    if (uart->tx_fd >= 0) {
+        fcntl(uart->tx_fd, F_SETFL, uart->tx_flags & ~O_NONBLOCK);
+        host_write(uart);
+        fcntl(uart->tx_fd, F_SETFL, uart->tx_flags);
+    }
+    if (uart->rx_fd >= 0 && uart->rx_fd != uart->tx_fd) {
+        fcntl(uart->rx_fd, F_SETFL, uart->rx_flags);
+        close(uart->rx_fd);
+    }
+    if (uart->tx_fd >= 0)
+        close(uart->tx_fd);
+    if (uart->epoll_fd >= 0)
+        close(uart->epoll_fd);
+    if (uart->tx_dropped)
+        printf("UART: %u bytes dropped\n", uart->tx_dropped);
+}
+
+#else
+
+bool uart_attach(SAU_UART* uart, int rx_fd, int tx_fd)
+{
+    (void)uart; (void)rx_fd; (void)tx_fd;
+    return false;
+}
+
+int uart_open_path(const char* path, bool output)
+{
+    (void)path; (void)output;
+    return -1;
+}
+
+int uart_connect_socket(const char* path)
+{
+    (void)path;
+    return -1;
+}
+
+void uart_poll(SAU_UART* uart, RL78_CPU* cpu)
+{
+    rx_kick(uart, cpu);
+}
+
+void uart_close(SAU_UART* uart)
+{
+    (void)uart;
+}
+
+#endif
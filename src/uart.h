@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct RL78_CPU;
+
+// UART0 on serial array unit 0: channel 0 transmits, channel 1 receives.
+// Only the registers below are modelled; everything else in the SAU is
+// plain memory.
+#define UART_TXD0   0xFFF10 // SDR00 low byte
+#define UART_SDR00H 0xFFF11 // SDR00[15:9] transmit baud divider
+#define UART_RXD0   0xFFF12 // SDR01 low byte
+#define UART_SDR01H 0xFFF13 // SDR01[15:9] receive baud divider
+#define UART_SSR00  0xF0100 // Channel 0 status
+#define UART_SSR01  0xF0102 // Channel 1 status
+#define UART_SIR00  0xF0104 // Channel 0 flag clear trigger
+#define UART_SIR01  0xF0106 // Channel 1 flag clear trigger
+#define UART_SE0    0xF0120 // Channel enable status
+#define UART_SS0    0xF0122 // Channel start trigger
+#define UART_ST0    0xF0124 // Channel stop trigger
+#define UART_SPS0   0xF0126 // Operation clock prescaler
+
+// SSR0n flags
+#define UART_SSR_TSF 0x40 // Transfer in progress
+#define UART_SSR_BFF 0x20 // Buffer register holds valid data
+#define UART_SSR_OVF 0x01 // Receive overrun
+
+// Host side FIFO size, must be a power of two
+#define UART_RING_SIZE 4096
+
+typedef struct {
+    uint8_t buf[UART_RING_SIZE];
+    uint32_t head; // Free running write index
+    uint32_t tail; // Free running read index
+} UART_Ring;
+
+typedef struct SAU_UART {
+    UART_Ring rx; // Host -> guest bytes waiting to be shifted in
+    UART_Ring tx; // Guest -> host bytes waiting to be written out
+    int rx_fd;
+    int tx_fd;
+    int epoll_fd;
+    int rx_flags; // Original fcntl flags, restored on close
+    int tx_flags;
+    bool rx_pollable; // False for regular files, which epoll rejects
+    uint8_t se; // SE0 channel enable bits
+    bool tx_busy; // A frame is on the wire
+    bool tx_buf_full; // SDR00 holds the next frame
+    uint8_t tx_shift;
+    uint8_t tx_buf;
+    bool rx_full; // RXD0 holds an unread byte
+    bool rx_overrun;
+    uint8_t rxd;
+    uint32_t tx_dropped; // Bytes lost because the host stopped reading
+} SAU_UART;
+
+void uart_init(SAU_UART* uart);
+bool uart_attach(SAU_UART* uart, int rx_fd, int tx_fd);
+int uart_open_path(const char* path, bool output);
+int uart_connect_socket(const char* path);
+void uart_close(SAU_UART* uart);
+
+bool uart_owns(uint32_t addr20);
+uint8_t uart_read(SAU_UART* uart, struct RL78_CPU* cpu, uint32_t addr20);
+void uart_write(SAU_UART* uart, struct RL78_CPU* cpu, uint32_t addr20, uint8_t data);
+
+void uart_poll(SAU_UART* uart, struct RL78_CPU* cpu);
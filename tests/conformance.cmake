@@ -0,0 +1,14 @@
+# Runs the conformance mode and compares its per-row digests with the
+# checked-in reference. Invoked by ctest, see CMakeLists.txt.
+execute_process(COMMAND ${EMULATOR} --conformance 400 --seed 1
+    OUTPUT_FILE ${ACTUAL}
+    RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "Live decoding and predecode disagree, see the cases above")
+endif()
+
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${REFERENCE} ${ACTUAL}
+    RESULT_VARIABLE differs)
+if(differs)
+    message(FATAL_ERROR "Instruction behaviour changed. Diff ${ACTUAL} against ${REFERENCE} to see which rows; if the change is intended, copy it over the reference.")
+endif()